@@ -0,0 +1,295 @@
+#include "acousticspace.h"
+#include "memoryaccounting.h"
+#include "agent.h"
+
+#include <QtConcurrent>
+#include <QColor>
+
+#include <numeric>
+
+QVector<QRgb> heatPalette()
+{
+    QVector<QRgb> palette;
+    for (int i=0; i<256; i++)
+    {
+        // near: red-yellow, far: blue
+        QColor color = QColor::fromHsv(240 * i / 255, 255, 255, 200 - i / 2);
+        palette.append(color.rgba());
+    }
+    return palette;
+}
+
+AcousticSpace::AcousticSpace(QRect bound)
+    :boundRect(bound)
+{
+    tilesInRow = (bound.width() + ACOUSTIC_TILE_SIZE - 1) >> ACOUSTIC_TILE_SIZE_BITS;
+    tilesInColumn = (bound.height() + ACOUSTIC_TILE_SIZE - 1) >> ACOUSTIC_TILE_SIZE_BITS;
+
+    tiles = new std::atomic<AcousticTile*> [tilesInRow * tilesInColumn];
+    for (int i=0; i<tilesInRow * tilesInColumn; i++)
+        tiles[i].store(nullptr, std::memory_order_relaxed);
+    MemoryAccounting::allocated(MemorySubsystem::AcousticSpace, tilesInRow * tilesInColumn * sizeof(std::atomic<AcousticTile*>), 0);
+}
+
+AcousticSpace::~AcousticSpace()
+{
+    foreach (int index, activeTiles)
+        delete tiles[index].load();
+    qDeleteAll(freeTiles);
+    delete [] tiles;
+
+    int tilesCount = activeTiles.count() + freeTiles.count();
+    MemoryAccounting::released(MemorySubsystem::AcousticSpace, tilesCount * sizeof(AcousticTile), tilesCount);
+    MemoryAccounting::released(MemorySubsystem::AcousticSpace, tilesInRow * tilesInColumn * sizeof(std::atomic<AcousticTile*>), 0);
+}
+
+bool AcousticSpace::precedes(const Agent* a, const Agent* b)
+{
+    return a->serialNumber() < b->serialNumber();
+}
+
+AcousticTile* AcousticSpace::allocateTile(int index)
+{
+    QMutexLocker lock(&tilesAllocationAccess);
+    AcousticTile* t = tiles[index].load(std::memory_order_relaxed);
+    if (!t)
+    {
+        if (freeTiles.isEmpty())
+        {
+            t = new AcousticTile;
+            MemoryAccounting::allocated(MemorySubsystem::AcousticSpace, sizeof(AcousticTile));
+        }
+        else
+            t = freeTiles.takeLast();
+        t->lastShoutTick.store(currentTick, std::memory_order_relaxed);
+        tiles[index].store(t, std::memory_order_release);
+        activeTiles.append(index);
+    }
+    return t;
+}
+
+AcousticMessage& AcousticSpace::cell(QPointF coord)
+{
+    int x_index = coord.x() - boundRect.left();
+    int y_index = coord.y() - boundRect.top();
+    if (x_index >=0 && y_index >= 0 && x_index < boundRect.width() && y_index<boundRect.height())
+    {
+        AcousticTile* t = tiles[tileIndex(x_index, y_index)].load(std::memory_order_acquire);
+        if (!t)
+            return silence;
+        return t->at(x_index & (ACOUSTIC_TILE_SIZE - 1), y_index & (ACOUSTIC_TILE_SIZE - 1));
+    }
+    else
+        throw std::range_error("index out of range");
+}
+
+AcousticHearing AcousticSpace::hear(QPointF coord)
+{
+    AcousticMessage& c = cell(coord);
+    AcousticHearing h;
+
+    c.minDistanceToResourceAccess.lock();
+    h.minDistanceToResource = heard(c.minDistanceToResource, c.minDistanceToResourceSender, c.minDistanceToResourceTick);
+    if (h.minDistanceToResource >= 0)
+        h.minDistanceToResourceSender = c.minDistanceToResourceSender;
+    c.minDistanceToResourceAccess.unlock();
+
+    c.minDistanceToWarehouseAccess.lock();
+    h.minDistanceToWarehouse = heard(c.minDistanceToWarehouse, c.minDistanceToWarehouseSender, c.minDistanceToWarehouseTick);
+    if (h.minDistanceToWarehouse >= 0)
+        h.minDistanceToWarehouseSender = c.minDistanceToWarehouseSender;
+    c.minDistanceToWarehouseAccess.unlock();
+
+    return h;
+}
+
+void AcousticSpace::setIncremental(bool on)
+{
+    QMutexLocker lock(&tilesAllocationAccess);
+    if (on == incremental)
+        return;
+    // start from silence in both directions
+    foreach (int index, activeTiles)
+        tiles[index].load(std::memory_order_relaxed)->clear();
+    incremental = on;
+}
+
+void AcousticSpace::clear()
+{
+    QMutexLocker lock(&tilesAllocationAccess);
+    for (int i = activeTiles.count() - 1; i >= 0; i--)
+    {
+        int index = activeTiles[i];
+        AcousticTile* t = tiles[index].load(std::memory_order_relaxed);
+        quint32 lastShoutTick = t->lastShoutTick.load(std::memory_order_relaxed);
+
+        if (lastShoutTick == currentTick)
+        {
+            if (!incremental)
+                t->clear();
+        }
+        else if (currentTick - lastShoutTick > ACOUSTIC_TILE_IDLE_TICKS)
+        {
+            // tile is already cleared (it was silent during last tick) or all its broadcasts have expired
+            if (incremental)
+                t->clear();
+            tiles[index].store(nullptr, std::memory_order_relaxed);
+            activeTiles[i] = activeTiles.last();
+            activeTiles.removeLast();
+
+            if (freeTiles.count() < ACOUSTIC_TILE_POOL_LIMIT)
+            {
+                freeTiles.append(t);
+            }
+            else
+            {
+                delete t;
+                MemoryAccounting::released(MemorySubsystem::AcousticSpace, sizeof(AcousticTile));
+            }
+        }
+    }
+    currentTick++;
+}
+
+void AcousticSpace::shout(const AcousticMessage& msg, QPoint pos, int range)
+{
+    auto& relPointsCollection = AcousticMessage::relativeCoordsCollection(range);
+    int lastTileIndex = -1;
+    AcousticTile* t = nullptr;
+    foreach(const QPoint& relPoint, relPointsCollection)
+    {
+        QPoint acousticCoord = pos + relPoint;
+        int x_index = acousticCoord.x() - boundRect.left();
+        int y_index = acousticCoord.y() - boundRect.top();
+        if (x_index >=0 && y_index >= 0 && x_index < boundRect.width() && y_index<boundRect.height())
+        {
+            int index = tileIndex(x_index, y_index);
+            if (index != lastTileIndex)
+            {
+                t = shoutTile(index);
+                lastTileIndex = index;
+            }
+
+            AcousticMessage& c = t->at(x_index & (ACOUSTIC_TILE_SIZE - 1), y_index & (ACOUSTIC_TILE_SIZE - 1));
+
+            c.minDistanceToResourceAccess.lock();
+            if (improves(c.minDistanceToResource, c.minDistanceToResourceSender, c.minDistanceToResourceTick,
+                         msg.minDistanceToResource, msg.minDistanceToResourceSender))
+            {
+                c.minDistanceToResource = msg.minDistanceToResource;
+                c.minDistanceToResourceSender = msg.minDistanceToResourceSender;
+                c.minDistanceToResourceTick = currentTick;
+            }
+            c.minDistanceToResourceAccess.unlock();
+
+            c.minDistanceToWarehouseAccess.lock();
+            if (improves(c.minDistanceToWarehouse, c.minDistanceToWarehouseSender, c.minDistanceToWarehouseTick,
+                         msg.minDistanceToWarehouse, msg.minDistanceToWarehouseSender))
+            {
+                c.minDistanceToWarehouse = msg.minDistanceToWarehouse;
+                c.minDistanceToWarehouseSender = msg.minDistanceToWarehouseSender;
+                c.minDistanceToWarehouseTick = currentTick;
+            }
+            c.minDistanceToWarehouseAccess.unlock();
+        }
+    }
+}
+
+void AcousticSpace::shoutExclusive(const AcousticMessage& msg, QPoint pos, int range, const QRect& clip)
+{
+    QRect area = clip.intersected(boundRect)
+                     .intersected(QRect(pos.x() - range, pos.y() - range, 2*range + 1, 2*range + 1));
+    if (area.isEmpty())
+        return;
+
+    auto& halfWidths = AcousticMessage::relativeRowsCollection(range);
+    for (int y = area.top(); y <= area.bottom(); y++)
+    {
+        int halfWidth = halfWidths[y - pos.y() + range];
+        int x_index = qMax(area.left(), pos.x() - halfWidth) - boundRect.left();
+        int last_x_index = qMin(area.right(), pos.x() + halfWidth) - boundRect.left();
+        int y_index = y - boundRect.top();
+
+        while (x_index <= last_x_index)
+        {
+            AcousticTile* t = shoutTile(tileIndex(x_index, y_index));
+            int tile_end_index = qMin(last_x_index, x_index | (ACOUSTIC_TILE_SIZE - 1));
+            AcousticMessage* c = &t->at(x_index & (ACOUSTIC_TILE_SIZE - 1), y_index & (ACOUSTIC_TILE_SIZE - 1));
+            for (; x_index <= tile_end_index; x_index++, c++)
+            {
+                if (improves(c->minDistanceToResource, c->minDistanceToResourceSender, c->minDistanceToResourceTick,
+                             msg.minDistanceToResource, msg.minDistanceToResourceSender))
+                {
+                    c->minDistanceToResource = msg.minDistanceToResource;
+                    c->minDistanceToResourceSender = msg.minDistanceToResourceSender;
+                    c->minDistanceToResourceTick = currentTick;
+                }
+                if (improves(c->minDistanceToWarehouse, c->minDistanceToWarehouseSender, c->minDistanceToWarehouseTick,
+                             msg.minDistanceToWarehouse, msg.minDistanceToWarehouseSender))
+                {
+                    c->minDistanceToWarehouse = msg.minDistanceToWarehouse;
+                    c->minDistanceToWarehouseSender = msg.minDistanceToWarehouseSender;
+                    c->minDistanceToWarehouseTick = currentTick;
+                }
+            }
+        }
+    }
+}
+
+void AcousticSpace::render(QImage& image, AcousticChannel channel, qreal farDistance) const
+{
+    static const QVector<QRgb> palette = heatPalette();
+
+    if (image.size() != boundRect.size() || image.format() != QImage::Format_ARGB32)
+        image = QImage(boundRect.size(), QImage::Format_ARGB32);
+
+    // detach once here, workers only write their own lines
+    uchar* bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+    int width = boundRect.width();
+    int height = boundRect.height();
+
+    QVector<int> tileRows(tilesInColumn);
+    std::iota(tileRows.begin(), tileRows.end(), 0);
+
+    QtConcurrent::blockingMap(tileRows, [=](int tileRow)
+    {
+        int lastLine = qMin(height, (tileRow + 1) * ACOUSTIC_TILE_SIZE);
+        for (int y = tileRow * ACOUSTIC_TILE_SIZE; y < lastLine; y++)
+        {
+            QRgb* line = reinterpret_cast<QRgb*>(bits + y * bytesPerLine);
+            for (int tileColumn=0; tileColumn<tilesInRow; tileColumn++)
+            {
+                int firstX = tileColumn * ACOUSTIC_TILE_SIZE;
+                int lastX = qMin(width, firstX + ACOUSTIC_TILE_SIZE);
+                const AcousticTile* t = tiles[tileRow * tilesInRow + tileColumn].load(std::memory_order_acquire);
+                if (!t)
+                {
+                    std::fill(line + firstX, line + lastX, 0);
+                    continue;
+                }
+
+                const AcousticMessage* c = &t->cells[(y & (ACOUSTIC_TILE_SIZE - 1)) * ACOUSTIC_TILE_SIZE];
+                for (int x = firstX; x < lastX; x++, c++)
+                {
+                    qreal distance = (channel == AcousticChannel::Resource)
+                            ? heard(c->minDistanceToResource, c->minDistanceToResourceSender, c->minDistanceToResourceTick)
+                            : heard(c->minDistanceToWarehouse, c->minDistanceToWarehouseSender, c->minDistanceToWarehouseTick);
+                    line[x] = distance >= 0 ? palette[qBound(0, (int)(distance / farDistance * 255), 255)] : 0;
+                }
+            }
+        }
+    });
+}
+
+int AcousticSpace::allocatedTilesCount() const
+{
+    QMutexLocker lock(&tilesAllocationAccess);
+    return activeTiles.count();
+}
+
+int AcousticSpace::pooledTilesCount() const
+{
+    QMutexLocker lock(&tilesAllocationAccess);
+    return freeTiles.count();
+}
@@ -0,0 +1,228 @@
+#ifndef ACOUSTICSPACE_H
+#define ACOUSTICSPACE_H
+
+#include <QRect>
+#include <QPoint>
+#include <QPointF>
+#include <QVector>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QMap>
+#include <QImage>
+
+#include <atomic>
+#include <stdexcept>
+
+const int ACOUSTIC_TILE_SIZE_BITS = 6;
+const int ACOUSTIC_TILE_SIZE = 1 << ACOUSTIC_TILE_SIZE_BITS;
+const quint32 ACOUSTIC_TILE_IDLE_TICKS = 50;
+const int ACOUSTIC_TILE_POOL_LIMIT = 64;
+/// incremental mode: broadcast distance grows by this per tick, not less than any agent's step
+const qreal ACOUSTIC_AGE_GROWTH = 3;
+/// incremental mode: broadcasts older than this are silence
+const quint32 ACOUSTIC_BROADCAST_TTL = 16;
+/// incremental mode: agents with nothing new repeat their broadcast this often, well before it expires
+const quint32 ACOUSTIC_RESHOUT_TICKS = 8;
+
+class Agent;
+
+enum class AcousticChannel {Resource, Warehouse};
+/// 256 colors from near (hot) to far (cold) used to render distance fields
+QVector<QRgb> heatPalette();
+
+struct AcousticMessage
+{
+    QMutex minDistanceToResourceAccess;
+    qreal minDistanceToResource = -1;
+    Agent* minDistanceToResourceSender = nullptr;
+    quint32 minDistanceToResourceTick = 0;
+
+    QMutex minDistanceToWarehouseAccess;
+    qreal minDistanceToWarehouse = -1;
+    Agent* minDistanceToWarehouseSender = nullptr;
+    quint32 minDistanceToWarehouseTick = 0;
+
+
+    /** For given radius return collection of points with integer coords that reside in circle with this raius and center (0,0)
+
+        For given radius results should be cached
+    */
+    static const QVector<QPoint>& relativeCoordsCollection(qint32 radius)
+    {
+        static QReadWriteLock lock;
+
+        static QMap<quint32, QVector<QPoint>> cache;
+
+        lock.lockForRead();
+        if (!cache.contains(radius))
+        {
+            lock.unlock();
+            lock.lockForWrite();
+            if (!cache.contains(radius))
+            {
+                for(qint32 x = -radius; x <= radius; x++)
+                    for(qint32 y = -radius; y <= radius; y++)
+                        if ( x*x + y*y <= radius*radius )
+                            cache[radius].append({x,y});
+            }
+        }
+        lock.unlock();
+        return cache[radius];
+    }
+
+    /** For given radius return half widths of circle rows: for every y in [-radius, radius] (stored at index y+radius)
+        the biggest x such as x*x + y*y <= radius*radius
+
+        Describes the same circle as relativeCoordsCollection, row by row
+    */
+    static const QVector<int>& relativeRowsCollection(qint32 radius)
+    {
+        static QReadWriteLock lock;
+
+        static QMap<quint32, QVector<int>> cache;
+
+        lock.lockForRead();
+        if (!cache.contains(radius))
+        {
+            lock.unlock();
+            lock.lockForWrite();
+            if (!cache.contains(radius))
+            {
+                QVector<int> rows;
+                for(qint32 y = -radius; y <= radius; y++)
+                {
+                    qint32 x = 0;
+                    while ( (x+1)*(x+1) + y*y <= radius*radius )
+                        x++;
+                    rows.append(x);
+                }
+                cache[radius] = rows;
+            }
+        }
+        lock.unlock();
+        return cache[radius];
+    }
+};
+
+/** Square block of ACOUSTIC_TILE_SIZE x ACOUSTIC_TILE_SIZE acoustic cells.
+
+    Tiles are allocated when somebody shouts into them for the first time and
+    are returned to the pool once nobody shouted into them for ACOUSTIC_TILE_IDLE_TICKS
+*/
+struct AcousticTile
+{
+    AcousticMessage cells[ACOUSTIC_TILE_SIZE * ACOUSTIC_TILE_SIZE];
+    std::atomic<quint32> lastShoutTick;
+
+    AcousticTile() : lastShoutTick(0) {}
+
+    AcousticMessage& at(int x, int y) { return cells[y * ACOUSTIC_TILE_SIZE + x]; }
+
+    void clear()
+    {
+        for (AcousticMessage& msg : cells)
+        {
+            msg.minDistanceToResourceSender = nullptr;
+            msg.minDistanceToWarehouseSender = nullptr;
+        }
+    }
+};
+
+/// what a listener hears in a cell, distances already aged
+struct AcousticHearing
+{
+    qreal minDistanceToResource = -1;
+    Agent* minDistanceToResourceSender = nullptr;
+    qreal minDistanceToWarehouse = -1;
+    Agent* minDistanceToWarehouseSender = nullptr;
+};
+
+class AcousticSpace
+{
+    QRect boundRect;
+    int tilesInRow = 0;
+    int tilesInColumn = 0;
+    std::atomic<AcousticTile*>* tiles = nullptr;
+
+    mutable QMutex tilesAllocationAccess;
+    QVector<int> activeTiles;
+    QVector<AcousticTile*> freeTiles;
+
+    quint32 currentTick = 1;
+    bool incremental = false;
+
+    /// returned to listeners in places nobody has shouted into
+    AcousticMessage silence;
+
+    int tileIndex(int x_index, int y_index) const
+    {
+        return (y_index >> ACOUSTIC_TILE_SIZE_BITS) * tilesInRow + (x_index >> ACOUSTIC_TILE_SIZE_BITS);
+    }
+    AcousticTile* allocateTile(int index);
+
+    /// distance of a broadcast heard now, or -1 if there's nothing to hear
+    qreal heard(qreal distance, const Agent* sender, quint32 stamp) const
+    {
+        if (!sender || currentTick - stamp > ACOUSTIC_BROADCAST_TTL)
+            return -1;
+        return distance + (currentTick - stamp) * ACOUSTIC_AGE_GROWTH;
+    }
+    /// sender with the lower serial number wins a tie, so the result doesn't depend on shouting order
+    static bool precedes(const Agent* a, const Agent* b);
+    /// cell is replaced by msg if it has nothing to hear or msg is nearer
+    bool improves(qreal distance, const Agent* sender, quint32 stamp, qreal msgDistance, const Agent* msgSender) const
+    {
+        qreal current = heard(distance, sender, stamp);
+        return current < 0 || current > msgDistance || (current == msgDistance && precedes(msgSender, sender));
+    }
+
+    /// tile with given index marked as shouted into during current tick
+    AcousticTile* shoutTile(int index)
+    {
+        AcousticTile* t = tiles[index].load(std::memory_order_acquire);
+        if (!t)
+            t = allocateTile(index);
+        if (t->lastShoutTick.load(std::memory_order_relaxed) != currentTick)
+            t->lastShoutTick.store(currentTick, std::memory_order_relaxed);
+        return t;
+    }
+
+public:
+    AcousticSpace(QRect bound);
+    ~AcousticSpace();
+
+    AcousticMessage& cell(QPointF coord);
+    AcousticHearing hear(QPointF coord);
+
+    quint32 tick() const {return currentTick;}
+
+    /** Field persists across ticks and broadcasts age by ACOUSTIC_AGE_GROWTH per tick instead of being cleared,
+        so only agents with something new have to shout. Must not be switched while a tick runs
+    */
+    void setIncremental(bool on);
+    bool isIncremental() const {return incremental;}
+
+    /// start a new tick: forget everything shouted during previous one unless incremental,
+    /// release tiles that stay silent for too long
+    void clear();
+
+    void shout(const AcousticMessage& msg, QPoint pos, int range);
+
+    /** Same as shout, but only cells inside clip are affected.
+
+        Caller guarantees nobody else writes into clip at the same time, so no cell locking is done
+    */
+    void shoutExclusive(const AcousticMessage& msg, QPoint pos, int range, const QRect& clip);
+
+    /** Paint one channel of the field into image (resized to the space bound if needed).
+
+        Each pixel is a cell: nearer distances are hotter, cells nobody shouted into are transparent.
+        Rows of tiles are painted in parallel, so the space must not be changed meanwhile
+    */
+    void render(QImage& image, AcousticChannel channel, qreal farDistance) const;
+
+    int allocatedTilesCount() const;
+    int pooledTilesCount() const;
+};
+
+#endif // ACOUSTICSPACE_H
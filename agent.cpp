@@ -1,17 +1,46 @@
 #include "agent.h"
-#include <QRandomGenerator>
 #include <QJsonObject>
 
 Agent::Agent(World *world, QPointF initialPosition, QObject *parent)
-    : WorldObject(parent), colorEmpty(QColor("red")), colorFull(QColor("green")), pWorld(world)
+    : Agent(world, initialPosition, world->nextAgentSeed(), MemorySubsystem::Agents, parent)
 {
+}
+
+Agent::Agent(World *world, QPointF initialPosition, quint64 seed, MemorySubsystem bucket, QObject *parent)
+    : WorldObject(parent), colorEmpty(QColor("red")), colorFull(QColor("green")), pWorld(world), memoryBucket(bucket)
+{
+    random.state = seed;
     setInitialSpeed();
     if (initialPosition == QPointF())
         setInitialCoord();
     else
         setPos( initialPosition );
 
-    ttl = QRandomGenerator::system()->bounded(6000, 10000);
+    ttl = random.bounded(6000, 10000);
+
+    // WorldObject part was accounted by the base class
+    MemoryAccounting::transfer(MemorySubsystem::WorldObjects, memoryBucket, sizeof(WorldObject));
+    MemoryAccounting::allocated(memoryBucket, sizeof(Agent) - sizeof(WorldObject), 0);
+}
+
+Agent::~Agent()
+{
+    MemoryAccounting::released(memoryBucket, sizeof(Agent) - sizeof(WorldObject), 0);
+    MemoryAccounting::transfer(memoryBucket, MemorySubsystem::WorldObjects, sizeof(WorldObject));
+}
+
+Agent* Agent::createGhost(World* world, QPointF position)
+{
+    // ghosts are moved by their owner domain, they never draw from their own generator
+    return new Agent(world, position, 0, MemorySubsystem::Ghosts, nullptr);
+}
+
+void Agent::markLeaked()
+{
+    if (memoryBucket == MemorySubsystem::DeadAgents)
+        return;
+    MemoryAccounting::transfer(memoryBucket, MemorySubsystem::DeadAgents, sizeof(Agent));
+    memoryBucket = MemorySubsystem::DeadAgents;
 }
 
 QColor Agent::color() const
@@ -20,7 +49,7 @@ QColor Agent::color() const
 }
 
 
-AgentAvatar* Agent::avatar() {return &avtr; }
+AgentAvatar* Agent::avatar() const {return &avtr; }
 
 void Agent::buildAvatar(QGraphicsScene *scene)
 {
@@ -37,6 +66,7 @@ void Agent::buildAvatar(QGraphicsScene *scene)
     avtr.grp = scene->createItemGroup({avtr.body, avtr.aura, avtr.direct, avtr.head});
 
     avtr.aura->hide();
+    MemoryAccounting::allocated(MemorySubsystem::SceneItems, AgentAvatar::sceneBytes(), AgentAvatar::sceneItemsCount);
 }
 
 Agent::State Agent::state() const
@@ -46,23 +76,48 @@ Agent::State Agent::state() const
     return qFuzzyIsNull(volume())?Empty:Full;
 }
 
-void Agent::acousticShout(AcousticSpace& space)
+void Agent::prepareShout(AcousticMessage& msg)
 {
-    AcousticMessage msg;
     msg.minDistanceToResourceSender = this;
     msg.minDistanceToWarehouse = distanceToWarehouse + shoutRange;
     msg.minDistanceToResource = distanceToResource+shoutRange;
     msg.minDistanceToWarehouseSender = this;
+}
+
+void Agent::planShout(quint32 tick, bool incremental)
+{
+    shouting = !incremental || shoutPending || tick - lastShoutTick >= ACOUSTIC_RESHOUT_TICKS;
+    if (shouting)
+    {
+        lastShoutTick = tick;
+        shoutPending = false;
+    }
+}
+
+void Agent::acousticShout(AcousticSpace& space)
+{
+    AcousticMessage msg;
+    prepareShout(msg);
 
     space.shout(msg, pos().toPoint(), (int)shoutRange);
 }
 
+void Agent::acousticShout(AcousticSpace& space, const QRect& clip)
+{
+    AcousticMessage msg;
+    prepareShout(msg);
+
+    space.shoutExclusive(msg, pos().toPoint(), (int)shoutRange, clip);
+}
+
 void Agent::acousticListen(AcousticSpace &space)
 {
-    AcousticMessage& v = space.cell(pos());
-    v.minDistanceToWarehouseAccess.lock();
+    AcousticHearing v = space.hear(pos());
     if (v.minDistanceToWarehouse < distanceToWarehouse && v.minDistanceToWarehouseSender)
     {
+        // less than a tick of ageing is not worth a broadcast
+        if (distanceToWarehouse - v.minDistanceToWarehouse >= ACOUSTIC_AGE_GROWTH)
+            shoutPending = true;
         distanceToWarehouse = static_cast<quint32>(v.minDistanceToWarehouse);
         if (state() == Agent::Full)
         {
@@ -71,10 +126,11 @@ void Agent::acousticListen(AcousticSpace &space)
             emit newCommunication(this, v.minDistanceToWarehouseSender);
         }
     }
-    v.minDistanceToWarehouseAccess.unlock();
 
     if (v.minDistanceToResource < distanceToResource && v.minDistanceToResourceSender)
     {
+        if (distanceToResource - v.minDistanceToResource >= ACOUSTIC_AGE_GROWTH)
+            shoutPending = true;
         distanceToResource = static_cast<quint32>(v.minDistanceToResource);
         if (state() == Agent::Empty)
         {
@@ -85,6 +141,32 @@ void Agent::acousticListen(AcousticSpace &space)
     }
 }
 
+void Agent::diffusionDeposit(DiffusionField& field) const
+{
+    field.deposit(pos(), distanceToResource, distanceToWarehouse);
+}
+
+void Agent::diffusionListen(const DiffusionField& field)
+{
+    qreal distance;
+    qreal angle = speed.angle;
+
+    if (field.sample(AcousticChannel::Warehouse, pos(), distance, angle) && distance < distanceToWarehouse)
+    {
+        distanceToWarehouse = distance;
+        if (state() == Agent::Full)
+            speed.angle = angle;
+    }
+
+    angle = speed.angle;
+    if (field.sample(AcousticChannel::Resource, pos(), distance, angle) && distance < distanceToResource)
+    {
+        distanceToResource = distance;
+        if (state() == Agent::Empty)
+            speed.angle = angle;
+    }
+}
+
 void Agent::read(const QJsonObject &json)
 {
     WorldObject::read(json);
@@ -94,6 +176,10 @@ void Agent::read(const QJsonObject &json)
         speed.angle = json["speed"].toObject()["angle"].toDouble();
         speed.dist = json["speed"].toObject()["distance"].toDouble();
     }
+    shoutRange = json["shout_range"].toDouble(shoutRange);
+    ttl = json["ttl"].toInt(ttl);
+    distanceToResource = json["distance_to_resource"].toDouble(distanceToResource);
+    distanceToWarehouse = json["distance_to_warehouse"].toDouble(distanceToWarehouse);
 }
 
 void Agent::write(QJsonObject &json) const
@@ -108,8 +194,8 @@ void Agent::write(QJsonObject &json) const
 
 void Agent::setInitialSpeed()
 {
-    speed.dist = QRandomGenerator::system()->bounded(1.0) + 2;
-    speed.angle = QRandomGenerator::system()->bounded(2 * PI);
+    speed.dist = random.bounded(1.0) + 2;
+    speed.angle = random.bounded(2 * PI);
 }
 
 void Agent::setInitialCoord()
@@ -117,6 +203,29 @@ void Agent::setInitialCoord()
     setPos( pWorld->randomWorldCoord(DEFAULT_INITIAL_AGENT_RADIUS) );
 }
 
+QPointF Agent::separation(QPointF at) const
+{
+    QPointF push;
+    // all agents are of the same size
+    qreal contact = 2 * radius();
+    pWorld->neighbors().forEachWithin(at, contact, [&](Agent* other, QPointF otherPos)
+    {
+        if (other == this)
+            return;
+        QPointF d = at - otherPos;
+        qreal dist = sqrt(d.x()*d.x() + d.y()*d.y());
+        if (qFuzzyIsNull(dist))
+        {
+            // same point: step away along own direction
+            d = QPointF(cos(speed.angle), sin(speed.angle));
+            dist = 1;
+        }
+        // both agents move, so each one covers half of the overlap
+        push += d / dist * (contact - dist) / 2;
+    });
+    return push;
+}
+
 void Agent::move()
 {
     if (ttl <= 0 || --ttl == 0)
@@ -125,6 +234,12 @@ void Agent::move()
     bool changeDirection = false;
     qreal dx = speed.dist * cos(speed.angle);
     qreal dy = speed.dist * sin(speed.angle);
+    if (pWorld->separatesThisTick())
+    {
+        QPointF push = separation(pos() + QPointF(dx, dy));
+        dx += push.x();
+        dy += push.y();
+    }
     if (pos().x() + dx + radius()> pWorld->maxXcoord()  )
     {
         dx = pWorld->maxXcoord() - (pos().x()  + dx + radius());
@@ -148,7 +263,7 @@ void Agent::move()
 
     if (changeDirection)
     {
-        speed.angle += QRandomGenerator::system()->bounded(PI);
+        speed.angle += random.bounded(PI);
         while (speed.angle < -PI)
             speed.angle += 2 * PI;
         while (speed.angle > PI)
@@ -168,6 +283,7 @@ void Agent::move()
             setVolume( pWorld->grabResource(resourcePoi, capacity()));
         }
         distanceToResource = 0;
+        shoutPending = true;
         speed.angle += PI;
         setPos( pos()- delta /*- delta*/);
 
@@ -194,6 +310,7 @@ void Agent::move()
         }
         speed.angle += PI;
         distanceToWarehouse = 0;
+        shoutPending = true;
         setPos( pos() - delta /*- delta*/);
 
         if (sqDistanceTo(warehousePoi->pos()) < pow(warehousePoi->radius()+radius(), 2))
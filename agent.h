@@ -2,6 +2,7 @@
 #define AGENT_H
 #include "world.h"
 #include "poi.h"
+#include "memoryaccounting.h"
 
 #include <QBrush>
 #include <QPen>
@@ -21,6 +22,14 @@ struct AgentAvatar
 
     bool valid = true;
 
+    /// shallow size of the items built by Agent::buildAvatar
+    static qint64 sceneBytes()
+    {
+        return sizeof(QGraphicsItemGroup) + sizeof(QGraphicsPolygonItem)
+                + 2 * sizeof(QGraphicsEllipseItem) + sizeof(QGraphicsLineItem);
+    }
+    static const int sceneItemsCount = 5;
+
     void setPos(QPointF p)
     { if (grp) grp->setPos(p);}
 
@@ -39,12 +48,12 @@ struct AgentAvatar
 
     void destroy()
     {
-        QGraphicsScene* scene = body->scene();
-        scene->removeItem(aura);
-        scene->removeItem(body);
-        scene->removeItem(aura);
-        scene->removeItem(direct);
-        scene->removeItem(head);
+        if (!grp)
+            return;
+
+        // group owns the rest of items and leaves the scene when deleted
+        delete grp;
+        MemoryAccounting::released(MemorySubsystem::SceneItems, sceneBytes(), sceneItemsCount);
 
         grp = nullptr;
         body = nullptr;
@@ -60,9 +69,32 @@ struct AgentAvatar
     }
 };
 
+/** Per agent random numbers (splitmix64).
+
+    Agents draw numbers in parallel, so every agent has its own generator seeded by the world
+    and a world seed reproduces the run. Eight bytes instead of the mt19937 state of QRandomGenerator
+*/
+struct AgentRandom
+{
+    quint64 state = 0;
+
+    quint64 generate()
+    {
+        quint64 z = (state += Q_UINT64_C(0x9E3779B97F4A7C15));
+        z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+        z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+        return z ^ (z >> 31);
+    }
+    /// [0, high)
+    qreal bounded(qreal high) { return (generate() >> 11) * (1.0 / Q_UINT64_C(9007199254740992)) * high; }
+    /// [low, high)
+    int bounded(int low, int high) { return low + (int)(generate() % (quint64)(high - low)); }
+};
+
 class Agent : public WorldObject
 {
     Q_OBJECT
+    friend class ReferenceWorld;
 public:
     enum State {Empty, Full, Dead};
 private:
@@ -76,7 +108,7 @@ private:
 //    qreal r = DEFAULT_INITIAL_AGENT_RADIUS;
     //qreal capacity = 1.0;
     //qreal carriedResourceVolume = 0;
-    qreal shoutRange = 50;
+    qreal shoutRange = DEFAULT_AGENT_SHOUT_RANGE;
     int ttl = 1000;
 
     QColor colorEmpty;
@@ -85,25 +117,60 @@ private:
     //State agentState;
 
     World* pWorld;
+    AgentRandom random;
 
     qreal distanceToResource = 10000;
     qreal distanceToWarehouse = 10000;
 
-    AgentAvatar  avtr;
+    /// incremental shouting: tick of the last broadcast and whether distances improved since
+    quint32 lastShoutTick = 0;
+    bool shoutPending = true;
+    bool shouting = true;
+
+    /// drawn by the GUI through read-only agent walks, not a part of agent state
+    mutable AgentAvatar  avtr;
+    MemorySubsystem memoryBucket = MemorySubsystem::Agents;
+
+    Agent(World* world, QPointF initialPosition, quint64 seed, MemorySubsystem bucket, QObject* parent);
+
+    void prepareShout(AcousticMessage& msg);
+    /// shift that moves agent at given position out of bodies of its neighbours
+    QPointF separation(QPointF at) const;
 public:
     Agent(World* world, QPointF initialPosition = QPointF(), QObject* parent = nullptr);
+    /// stand-in for an agent of a neighbouring domain: draws no seed of the world and is accounted as a ghost
+    static Agent* createGhost(World* world, QPointF position);
+    ~Agent();
 
-    AgentAvatar* avatar();
+    /// agent removed from the world is accounted as dead until it's reclaimed
+    void markLeaked();
+
+    AgentAvatar* avatar() const;
     void buildAvatar(QGraphicsScene* scene);
 
 
     State state() const;
 
     qreal direction() const {return speed.angle;}
+    int timeToLive() const {return ttl;}
+    qreal shoutingRange() const {return shoutRange;}
+    qreal resourceDistance() const {return distanceToResource;}
+    qreal warehouseDistance() const {return distanceToWarehouse;}
+
+    void setShoutingRange(qreal range) {shoutRange = range;}
+    void setDistances(qreal toResource, qreal toWarehouse) {distanceToResource = toResource; distanceToWarehouse = toWarehouse;}
+
+    /// decide during move phase whether agent shouts this tick; without incremental shouting it always does
+    void planShout(quint32 tick, bool incremental);
+    bool shoutsThisTick() const {return shouting;}
 
     void acousticShout(AcousticSpace &space);
+    void acousticShout(AcousticSpace &space, const QRect& clip);
     void acousticListen(AcousticSpace &space);
 
+    void diffusionDeposit(DiffusionField& field) const;
+    void diffusionListen(const DiffusionField& field);
+
     QColor color() const;
 
     void read (const QJsonObject& json);
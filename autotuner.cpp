@@ -0,0 +1,92 @@
+#include "autotuner.h"
+
+const int TUNE_MOVES_COUNT = 4;
+
+TickTuner::TickTuner(int maxThreads, int granularityLevels, TuneSettings initial)
+    : maxThreads(qMax(1, maxThreads)), granularityLevels(qMax(1, granularityLevels)),
+      current(initial), accepted(initial)
+{}
+
+bool TickTuner::neighbour(int move, TuneSettings& probe) const
+{
+    probe = accepted;
+    // threads move by a quarter, so a many-core machine is covered in a few windows
+    int threadStep = qMax(1, accepted.threads / 4);
+    switch (move)
+    {
+    case 0: probe.threads = qMin(maxThreads, accepted.threads + threadStep); break;
+    case 1: probe.threads = qMax(1, accepted.threads - threadStep);          break;
+    case 2: probe.granularity = qMin(granularityLevels - 1, accepted.granularity + 1); break;
+    case 3: probe.granularity = qMax(0, accepted.granularity - 1);                    break;
+    }
+    return probe != accepted;
+}
+
+void TickTuner::nextProbe()
+{
+    // moves that hit a limit count as failed
+    while (failedMoves < TUNE_MOVES_COUNT)
+    {
+        TuneSettings probe;
+        if (neighbour(move, probe))
+        {
+            current = probe;
+            state = State::Probe;
+            return;
+        }
+        failedMoves++;
+        move = (move + 1) % TUNE_MOVES_COUNT;
+    }
+
+    current = accepted;
+    state = State::Settled;
+    settledWindows = 0;
+}
+
+bool TickTuner::addTick(qint64 parallelNs, int agentsCount)
+{
+    windowCost += (qreal)parallelNs / qMax(1, agentsCount);
+    if (++windowTicks < TUNE_WINDOW_TICKS)
+        return false;
+
+    qreal cost = windowCost / windowTicks;
+    windowTicks = 0;
+    windowCost = 0;
+
+    TuneSettings before = current;
+    switch (state)
+    {
+    case State::Baseline:
+        acceptedCost = cost;
+        failedMoves = 0;
+        nextProbe();
+        break;
+
+    case State::Probe:
+        if (cost < acceptedCost * (1 - TUNE_MIN_GAIN))
+        {
+            // keep going the same way
+            accepted = current;
+            acceptedCost = cost;
+            failedMoves = 0;
+        }
+        else
+        {
+            current = accepted;
+            failedMoves++;
+            move = (move + 1) % TUNE_MOVES_COUNT;
+        }
+        nextProbe();
+        break;
+
+    case State::Settled:
+        if (++settledWindows < TUNE_SETTLE_WINDOWS)
+            break;
+        // workload may have changed meanwhile: this window is the new baseline
+        acceptedCost = cost;
+        failedMoves = 0;
+        nextProbe();
+        break;
+    }
+    return current != before;
+}
@@ -0,0 +1,61 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <QtGlobal>
+
+/// ticks measured before settings are judged
+const int TUNE_WINDOW_TICKS = 32;
+/// a probe is kept only if it makes a tick at least this much cheaper
+const qreal TUNE_MIN_GAIN = 0.03;
+/// windows to stay put once no neighbouring setting is better
+const int TUNE_SETTLE_WINDOWS = 16;
+
+/// what the tuner controls
+struct TuneSettings
+{
+    int threads = 1;
+    /// index into the granularity levels of the caller, e.g. chunk sizes
+    int granularity = 0;
+
+    bool operator==(const TuneSettings& other) const {return threads == other.threads && granularity == other.granularity;}
+    bool operator!=(const TuneSettings& other) const {return !(*this == other);}
+};
+
+/** Online hill climbing over worker count and work granularity.
+
+    Cost of a setting is the mean parallel time per agent over TUNE_WINDOW_TICKS ticks. The tuner probes one
+    neighbouring setting at a time (more or fewer threads, finer or coarser work) and keeps it if it's cheaper,
+    otherwise goes back. Once no neighbour wins it settles for a while and then starts probing again,
+    so it follows a workload and a machine that change during the run
+*/
+class TickTuner
+{
+    enum class State {Baseline, Probe, Settled};
+
+    int maxThreads;
+    int granularityLevels;
+
+    State state = State::Baseline;
+    TuneSettings current;
+    TuneSettings accepted;
+    qreal acceptedCost = 0;
+    /// next of the four moves to probe: threads up/down, granularity up/down
+    int move = 0;
+    int failedMoves = 0;
+    int settledWindows = 0;
+
+    int windowTicks = 0;
+    qreal windowCost = 0;
+
+    bool neighbour(int move, TuneSettings& probe) const;
+    void nextProbe();
+
+public:
+    TickTuner(int maxThreads, int granularityLevels, TuneSettings initial);
+
+    /// account one tick, true if settings() changed and have to be applied before the next one
+    bool addTick(qint64 parallelNs, int agentsCount);
+    TuneSettings settings() const {return current;}
+};
+
+#endif // AUTOTUNER_H
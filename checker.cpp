@@ -0,0 +1,241 @@
+#include "world.h"
+#include "agent.h"
+#include "referenceworld.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHash>
+
+#include <algorithm>
+#include <stdexcept>
+
+static bool agrees(qreal a, qreal b, qreal tolerance)
+{
+    return qAbs(a - b) <= tolerance * qMax((qreal)1, qMax(qAbs(a), qAbs(b)));
+}
+
+static QString differs(const char* what, qreal production, qreal reference)
+{
+    return QString("%1: %2 in production, %3 in reference").arg(what).arg(production, 0, 'g', 17).arg(reference, 0, 'g', 17);
+}
+
+/** First difference between the engines after a tick, empty if they agree.
+
+    With raced set, agents and resources of the last tick's races and the counts they change are left out
+*/
+static QString firstDifference(World& world, const ReferenceWorld& reference, qreal tolerance, bool raced = false)
+{
+    const QSet<quint32>& racedAgents = reference.racedAgentSerials();
+    const QVector<QPointF>& racedResources = reference.racedResourcePositions();
+
+    WorldStats p = world.stats();
+    WorldStats r = reference.stats();
+    if (p.tick != r.tick)
+        return differs("tick", p.tick, r.tick);
+    if (!raced && p.emptyAgentsCount != r.emptyAgentsCount)
+        return differs("empty agents", p.emptyAgentsCount, r.emptyAgentsCount);
+    if (!raced && p.fullAgentsCount != r.fullAgentsCount)
+        return differs("full agents", p.fullAgentsCount, r.fullAgentsCount);
+    if (p.agentsCount() != r.agentsCount())
+        return differs("agents", p.agentsCount(), r.agentsCount());
+    if (p.births != r.births)
+        return differs("births", p.births, r.births);
+    if (p.deaths != r.deaths)
+        return differs("deaths", p.deaths, r.deaths);
+    if (!raced && p.resourcesCount != r.resourcesCount)
+        return differs("resources", p.resourcesCount, r.resourcesCount);
+    if (p.warehousesCount != r.warehousesCount)
+        return differs("warehouses", p.warehousesCount, r.warehousesCount);
+    if (!agrees(p.meanTtl, r.meanTtl, tolerance))
+        return differs("mean ttl", p.meanTtl, r.meanTtl);
+    if (!agrees(p.warehouseVolume, r.warehouseVolume, tolerance))
+        return differs("warehouse volume", p.warehouseVolume, r.warehouseVolume);
+    if (!agrees(p.resourcesDelivered, r.resourcesDelivered, tolerance))
+        return differs("resources delivered", p.resourcesDelivered, r.resourcesDelivered);
+
+    QHash<quint32, const Agent*> alive;
+    world.forEachAgent([&alive](const Agent* agent)
+    {
+        if (agent->state() != Agent::Dead)
+            alive[agent->serialNumber()] = agent;
+    });
+    foreach (const ReferenceAgent& expected, reference.agentList())
+    {
+        if (expected.state() == Agent::Dead)
+            continue;
+        const Agent* agent = alive.take(expected.serial);
+        QString prefix = QString("agent %1 ").arg(expected.serial);
+        if (!agent)
+            return prefix + "is alive in reference only";
+        if (raced && racedAgents.contains(expected.serial))
+            continue;
+        if (agent->state() != expected.state())
+            return prefix + differs("state", agent->state(), expected.state());
+        if (agent->timeToLive() != expected.ttl)
+            return prefix + differs("ttl", agent->timeToLive(), expected.ttl);
+        if (!agrees(agent->pos().x(), expected.pos.x(), tolerance))
+            return prefix + differs("x", agent->pos().x(), expected.pos.x());
+        if (!agrees(agent->pos().y(), expected.pos.y(), tolerance))
+            return prefix + differs("y", agent->pos().y(), expected.pos.y());
+        if (!agrees(agent->direction(), expected.angle, tolerance))
+            return prefix + differs("direction", agent->direction(), expected.angle);
+        if (!agrees(agent->volume(), expected.volume, tolerance))
+            return prefix + differs("volume", agent->volume(), expected.volume);
+        if (!agrees(agent->resourceDistance(), expected.distanceToResource, tolerance))
+            return prefix + differs("distance to resource", agent->resourceDistance(), expected.distanceToResource);
+        if (!agrees(agent->warehouseDistance(), expected.distanceToWarehouse, tolerance))
+            return prefix + differs("distance to warehouse", agent->warehouseDistance(), expected.distanceToWarehouse);
+    }
+    if (!alive.isEmpty())
+        return QString("agent %1 is alive in production only").arg(alive.begin().key());
+
+    // serials of resources appearing in the same tick follow the order they were depleted in, compare places
+    auto byPosition = [](const ReferencePoi& a, const ReferencePoi& b)
+    {
+        return a.pos.x() < b.pos.x() || (a.pos.x() == b.pos.x() && a.pos.y() < b.pos.y());
+    };
+    QVector<ReferencePoi> produced;
+    world.forEachResource([&produced](const WorldObject* poi)
+    {
+        ReferencePoi p;
+        p.pos = poi->pos();
+        p.radius = poi->radius();
+        p.volume = poi->volume();
+        if (poi->isValid())
+            produced.append(p);
+    });
+    QVector<ReferencePoi> expected;
+    foreach (const ReferencePoi& poi, reference.resourceList())
+        if (poi.valid)
+            expected.append(poi);
+    if (raced)
+    {
+        // a resource production did or didn't deplete may leave one more new resource there, drawn anywhere
+        auto isRaced = [&racedResources](const ReferencePoi& poi) { return racedResources.contains(poi.pos); };
+        expected.erase(std::remove_if(expected.begin(), expected.end(), isRaced), expected.end());
+        produced.erase(std::remove_if(produced.begin(), produced.end(), isRaced), produced.end());
+        if (produced.count() > expected.count() + racedResources.count())
+            return differs("valid resources out of races", produced.count(), expected.count());
+        QVector<ReferencePoi> matched;
+        foreach (const ReferencePoi& poi, expected)
+        {
+            auto found = std::find_if(produced.constBegin(), produced.constEnd(),
+                                      [&poi](const ReferencePoi& other) { return other.pos == poi.pos; });
+            if (found == produced.constEnd())
+                return QString("resource at %1,%2 is in reference only").arg(poi.pos.x()).arg(poi.pos.y());
+            matched.append(*found);
+        }
+        produced = matched;
+    }
+    if (produced.count() != expected.count())
+        return differs("valid resources", produced.count(), expected.count());
+    std::sort(produced.begin(), produced.end(), byPosition);
+    std::sort(expected.begin(), expected.end(), byPosition);
+    for (int i=0; i<expected.count(); i++)
+    {
+        QString prefix = QString("resource at %1,%2 ").arg(expected[i].pos.x()).arg(expected[i].pos.y());
+        if (produced[i].pos != expected[i].pos)
+            return prefix + QString("is at %1,%2 in production").arg(produced[i].pos.x()).arg(produced[i].pos.y());
+        if (!agrees(produced[i].volume, expected[i].volume, tolerance))
+            return prefix + differs("volume", produced[i].volume, expected[i].volume);
+        if (!agrees(produced[i].radius, expected[i].radius, tolerance))
+            return prefix + differs("radius", produced[i].radius, expected[i].radius);
+    }
+
+    int index = 0;
+    QString difference;
+    world.forEachWarehouse([&](const WorldObject* poi)
+    {
+        if (!difference.isEmpty())
+            return;
+        if (index == reference.warehouseList().count())
+        {
+            difference = QString("warehouse at %1,%2 is in production only").arg(poi->pos().x()).arg(poi->pos().y());
+            return;
+        }
+        const ReferencePoi& warehouse = reference.warehouseList().at(index++);
+        QString prefix = QString("warehouse %1 ").arg(warehouse.serial);
+        if (!agrees(poi->volume(), warehouse.volume, tolerance))
+            difference = prefix + differs("volume", poi->volume(), warehouse.volume);
+        else if (!agrees(poi->radius(), warehouse.radius, tolerance))
+            difference = prefix + differs("radius", poi->radius(), warehouse.radius);
+    });
+    return difference;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the parallel tick and the serial reference from the same seed and compares them "
+                                     "after every tick.\nExit code: 0 agree, 1 diverged, 2 diverged only in agents and resources "
+                                     "that raced for a resource (order dependent, inconclusive), 3 bad setup");
+    parser.addHelpOption();
+    QCommandLineOption ticksOption("ticks", "Number of ticks to compare", "count", "2000");
+    QCommandLineOption seedOption("seed", "Random seed of the world", "seed", "1");
+    QCommandLineOption agentsOption("agents", "Initial number of agents", "count", QString::number(AGENTS_COUNT));
+    QCommandLineOption plainOption("plain", "Check the tick without spatial decomposition");
+    QCommandLineOption threadsOption("threads", "Worker threads of the tick, the ideal thread count if not set", "count");
+    QCommandLineOption chunkLevelOption("chunk-level", "Agents per task with --plain, index into the tuned chunk sizes "
+                                        "(0 is the smallest)", "level", QString::number(DEFAULT_CHUNK_LEVEL));
+    QCommandLineOption autotuneOption("autotune", "Let autotuning change worker count and granularity meanwhile");
+    QCommandLineOption reorderOption("reorder-agents", "Keep agents sorted by position along a Morton curve");
+    QCommandLineOption separationOption("separation", "Agents push each other apart instead of passing through");
+    QCommandLineOption toleranceOption("tolerance", "Relative difference of real values still taken as equal", "tolerance", "1e-9");
+    parser.addOptions({ticksOption, seedOption, agentsOption, plainOption, threadsOption, chunkLevelOption, autotuneOption,
+                       reorderOption, separationOption, toleranceOption});
+    parser.process(app);
+
+    quint64 ticks = parser.value(ticksOption).toULongLong();
+    qreal tolerance = parser.value(toleranceOption).toDouble();
+    World world;
+    if (parser.isSet(threadsOption))
+        world.setWorkerThreads(parser.value(threadsOption).toInt());
+    world.setSeed(parser.value(seedOption).toUInt());
+    world.setInitialAgentsCount(parser.value(agentsOption).toInt());
+    world.setSpatialDecomposition(!parser.isSet(plainOption));
+    world.setChunkLevel(parser.value(chunkLevelOption).toInt());
+    world.setAutotuning(parser.isSet(autotuneOption));
+    world.setLocalityReordering(parser.isSet(reorderOption));
+    world.setAgentSeparation(parser.isSet(separationOption));
+    world.onStart();
+
+    try
+    {
+        ReferenceWorld reference(world);
+        QString difference = firstDifference(world, reference, tolerance);
+        for (quint64 i=0; difference.isEmpty() && i<ticks; i++)
+        {
+            world.iteration();
+            reference.iteration();
+            difference = firstDifference(world, reference, tolerance);
+        }
+
+        if (difference.isEmpty())
+        {
+            WorldStats s = world.stats();
+            qInfo("%llu ticks agree: %d agents, %llu born, %llu died", (unsigned long long)ticks, s.agentsCount(),
+                  (unsigned long long)s.totalBirths, (unsigned long long)s.totalDeaths);
+            return 0;
+        }
+
+        qWarning("diverged at tick %llu: %s", (unsigned long long)reference.tickCount(), qPrintable(difference));
+        if (reference.racedResourceHits())
+        {
+            qWarning("%d agents raced for a resource depleted or created in the same tick, who gets it depends on agent order",
+                     reference.racedResourceHits());
+            // only differences the races can explain are inconclusive
+            QString beyondRaces = firstDifference(world, reference, tolerance, true);
+            if (beyondRaces.isEmpty())
+                return 2;
+            qWarning("differs beyond the races: %s", qPrintable(beyondRaces));
+        }
+        return 1;
+    }
+    catch (const std::exception& e)
+    {
+        qWarning("%s", e.what());
+        return 3;
+    }
+}
@@ -0,0 +1,217 @@
+#include "diffusionfield.h"
+#include "memoryaccounting.h"
+#include "poolmap.h"
+
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <math.h>
+
+static const float FAR_AWAY = std::numeric_limits<float>::infinity();
+
+static QVector<int> rowBands(int rows)
+{
+    QVector<int> bands;
+    for (int row=0; row<rows; row+=DIFFUSION_ROWS_PER_TASK)
+        bands.append(row);
+    return bands;
+}
+
+/// lower cell to value unless it already holds less
+static void lower(std::atomic<float>& cell, float value)
+{
+    float current = cell.load(std::memory_order_relaxed);
+    while (value < current && !cell.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+}
+
+DiffusionField::DiffusionField(QRect bound, qreal cellSize)
+    :boundRect(bound), cellSize(cellSize)
+{
+    columns = qMax(1, (int)ceil(bound.width() / cellSize));
+    rows = qMax(1, (int)ceil(bound.height() / cellSize));
+
+    for (int channel=0; channel<2; channel++)
+    {
+        field[channel].fill(FAR_AWAY, columns * rows);
+        scratch[channel].fill(FAR_AWAY, columns * rows);
+        deposits[channel] = new std::atomic<float> [columns * rows];
+        for (int i=0; i<columns * rows; i++)
+            deposits[channel][i].store(FAR_AWAY, std::memory_order_relaxed);
+    }
+    MemoryAccounting::allocated(MemorySubsystem::DiffusionField, bytes());
+}
+
+DiffusionField::~DiffusionField()
+{
+    MemoryAccounting::released(MemorySubsystem::DiffusionField, bytes());
+    delete [] deposits[0];
+    delete [] deposits[1];
+}
+
+qint64 DiffusionField::bytes() const
+{
+    return sizeof(DiffusionField) + 2 * (qint64)columns * rows * (2 * sizeof(float) + sizeof(std::atomic<float>));
+}
+
+int DiffusionField::cellIndex(QPointF pos) const
+{
+    int column = qBound(0, (int)floor((pos.x() - boundRect.left()) / cellSize), columns - 1);
+    int row = qBound(0, (int)floor((pos.y() - boundRect.top()) / cellSize), rows - 1);
+    return row * columns + column;
+}
+
+void DiffusionField::clear()
+{
+    for (int channel=0; channel<2; channel++)
+    {
+        field[channel].fill(FAR_AWAY);
+        for (int i=0; i<columns * rows; i++)
+            deposits[channel][i].store(FAR_AWAY, std::memory_order_relaxed);
+    }
+}
+
+void DiffusionField::deposit(QPointF pos, qreal toResource, qreal toWarehouse)
+{
+    int i = cellIndex(pos);
+    lower(deposits[(int)AcousticChannel::Resource][i], toResource);
+    lower(deposits[(int)AcousticChannel::Warehouse][i], toWarehouse);
+}
+
+void DiffusionField::sweep(const float* from, float* to, int firstRow, int lastRow) const
+{
+    const float straight = cellSize;
+    const float diagonal = cellSize * M_SQRT2;
+
+    // plain loops over whole rows, so the compiler vectorizes them
+    for (int y = firstRow; y < lastRow; y++)
+    {
+        const float* row = from + y * columns;
+        // outside rows repeat the edge one, which never lowers anything
+        const float* up = y > 0 ? row - columns : row;
+        const float* down = y < rows - 1 ? row + columns : row;
+        float* out = to + y * columns;
+
+        for (int x = 0; x < columns; x++)
+            out[x] = std::min(row[x], std::min(up[x], down[x]) + straight);
+        for (int x = 1; x < columns; x++)
+        {
+            out[x] = std::min(out[x], row[x-1] + straight);
+            out[x] = std::min(out[x], std::min(up[x-1], down[x-1]) + diagonal);
+        }
+        for (int x = 0; x < columns - 1; x++)
+        {
+            out[x] = std::min(out[x], row[x+1] + straight);
+            out[x] = std::min(out[x], std::min(up[x+1], down[x+1]) + diagonal);
+        }
+    }
+}
+
+void DiffusionField::relax(qreal reach, QThreadPool* pool)
+{
+    QVector<int> bands = rowBands(rows);
+
+    // raw pointers: detaching QVectors is not for worker threads
+    float* cells[2] = {field[0].data(), field[1].data()};
+    float* next[2] = {scratch[0].data(), scratch[1].data()};
+    std::atomic<float>* const* newDeposits = deposits;
+    const int width = columns;
+    const int height = rows;
+
+    blockingMapOn(pool, bands, [=](int firstRow)
+    {
+        int last = qMin(height, firstRow + DIFFUSION_ROWS_PER_TASK) * width;
+        for (int channel=0; channel<2; channel++)
+            for (int i = firstRow * width; i < last; i++)
+                cells[channel][i] = std::min(cells[channel][i] + DIFFUSION_AGE_GROWTH,
+                                             newDeposits[channel][i].exchange(FAR_AWAY, std::memory_order_relaxed));
+    });
+
+    int sweeps = qMax(1, (int)ceil(reach / cellSize));
+    for (int s=0; s<sweeps; s++)
+    {
+        blockingMapOn(pool, bands, [=](int firstRow)
+        {
+            int lastRow = qMin(height, firstRow + DIFFUSION_ROWS_PER_TASK);
+            for (int channel=0; channel<2; channel++)
+                sweep(cells[channel], next[channel], firstRow, lastRow);
+        });
+        std::swap(cells[0], next[0]);
+        std::swap(cells[1], next[1]);
+    }
+
+    // result of an odd number of sweeps is in the scratch grids
+    if (sweeps & 1)
+    {
+        field[0].swap(scratch[0]);
+        field[1].swap(scratch[1]);
+    }
+}
+
+bool DiffusionField::sample(AcousticChannel channel, QPointF pos, qreal& distance, qreal& angle) const
+{
+    const QVector<float>& cells = field[(int)channel];
+    int i = cellIndex(pos);
+    float value = cells[i];
+    if (qIsInf(value))
+        return false;
+    distance = value;
+
+    int column = i % columns;
+    int row = i / columns;
+    float best = value;
+    int bestDx = 0;
+    int bestDy = 0;
+    for (int dy=-1; dy<=1; dy++)
+    {
+        if (row + dy < 0 || row + dy >= rows)
+            continue;
+        for (int dx=-1; dx<=1; dx++)
+        {
+            if (column + dx < 0 || column + dx >= columns)
+                continue;
+            float neighbour = cells[i + dy * columns + dx];
+            if (neighbour < best)
+            {
+                best = neighbour;
+                bestDx = dx;
+                bestDy = dy;
+            }
+        }
+    }
+
+    // angle is kept where the cell is the bottom of its neighbourhood
+    if (bestDx || bestDy)
+        angle = atan2(bestDy, bestDx);
+    return true;
+}
+
+void DiffusionField::render(QImage& image, AcousticChannel channel, qreal farDistance) const
+{
+    static const QVector<QRgb> palette = heatPalette();
+
+    if (image.size() != boundRect.size() || image.format() != QImage::Format_ARGB32)
+        image = QImage(boundRect.size(), QImage::Format_ARGB32);
+
+    // detach once here, workers only write their own lines
+    uchar* bits = image.bits();
+    int bytesPerLine = image.bytesPerLine();
+    int width = boundRect.width();
+    const float* cells = field[(int)channel].constData();
+
+    QVector<int> lines(boundRect.height());
+    std::iota(lines.begin(), lines.end(), 0);
+
+    QtConcurrent::blockingMap(lines, [=](int y)
+    {
+        QRgb* line = reinterpret_cast<QRgb*>(bits + y * bytesPerLine);
+        const float* cellRow = cells + qMin(rows - 1, (int)(y / cellSize)) * columns;
+        for (int x = 0; x < width; x++)
+        {
+            float distance = cellRow[qMin(columns - 1, (int)(x / cellSize))];
+            line[x] = qIsInf(distance) ? 0 : palette[qBound(0, (int)(distance / farDistance * 255), 255)];
+        }
+    });
+}
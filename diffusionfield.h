@@ -0,0 +1,74 @@
+#ifndef DIFFUSIONFIELD_H
+#define DIFFUSIONFIELD_H
+
+#include "acousticspace.h"
+
+#include <QRect>
+#include <QPointF>
+#include <QVector>
+#include <QImage>
+#include <QThreadPool>
+
+#include <atomic>
+
+const qreal DIFFUSION_CELL_SIZE = 4;
+/// distance kept in a cell grows by this per tick, as broadcasts of incremental acoustic field do
+const float DIFFUSION_AGE_GROWTH = 3;
+/// rows relaxed by one worker
+const int DIFFUSION_ROWS_PER_TASK = 16;
+
+/// how agents tell each other distances to resources and warehouses
+enum class CommunicationModel {Acoustic, Diffusion};
+
+/** Distance field relaxed by a min-plus stencil, alternative to shouting into AcousticSpace.
+
+    Agents deposit their distances into the cell under them, then every sweep lowers each cell to the least of
+    its neighbours plus the cell size (a distance transform step), so a sweep carries news one cell further.
+    Cost of a tick is cells x sweeps and doesn't depend on how many agents there are or how far they shout.
+    Agents read the value under them and go down the steepest slope around it
+*/
+class DiffusionField
+{
+    QRect boundRect;
+    qreal cellSize;
+    int columns = 0;
+    int rows = 0;
+
+    /// one grid per channel, infinity where nothing is known
+    QVector<float> field[2];
+    QVector<float> scratch[2];
+    /// deposits of current tick, merged into field by relax()
+    std::atomic<float>* deposits[2];
+
+    int cellIndex(QPointF pos) const;
+    /// one relaxation step of rows [firstRow, lastRow) of a channel
+    void sweep(const float* from, float* to, int firstRow, int lastRow) const;
+    qint64 bytes() const;
+
+public:
+    DiffusionField(QRect bound, qreal cellSize = DIFFUSION_CELL_SIZE);
+    ~DiffusionField();
+
+    DiffusionField(const DiffusionField&) = delete;
+    DiffusionField& operator=(const DiffusionField&) = delete;
+
+    /// forget everything
+    void clear();
+
+    /// may be called from many threads at once, but not together with relax()
+    void deposit(QPointF pos, qreal toResource, qreal toWarehouse);
+
+    /// age the field, merge deposits and spread them reach pixels further, in parallel on pool
+    void relax(qreal reach, QThreadPool* pool);
+
+    /** Distance known at pos and direction to the neighbouring cell nearest to the target.
+
+        False if the field knows nothing there
+    */
+    bool sample(AcousticChannel channel, QPointF pos, qreal& distance, qreal& angle) const;
+
+    /// same as AcousticSpace::render, cells are scaled up to the world size
+    void render(QImage& image, AcousticChannel channel, qreal farDistance) const;
+};
+
+#endif // DIFFUSIONFIELD_H
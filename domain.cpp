@@ -0,0 +1,347 @@
+#include "domain.h"
+#include "world.h"
+#include "agent.h"
+
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QtEndian>
+
+#include <math.h>
+
+QDataStream& operator<<(QDataStream& stream, const DomainGhost& ghost)
+{
+    return stream << ghost.pos << ghost.shoutRange << ghost.distanceToResource << ghost.distanceToWarehouse;
+}
+
+QDataStream& operator>>(QDataStream& stream, DomainGhost& ghost)
+{
+    return stream >> ghost.pos >> ghost.shoutRange >> ghost.distanceToResource >> ghost.distanceToWarehouse;
+}
+
+QDataStream& operator<<(QDataStream& stream, const DomainPoiState& state)
+{
+    return stream << state.serial << state.warehouse << state.valid << state.pos
+                  << state.radius << state.volume << state.capacity;
+}
+
+QDataStream& operator>>(QDataStream& stream, DomainPoiState& state)
+{
+    return stream >> state.serial >> state.warehouse >> state.valid >> state.pos
+                  >> state.radius >> state.volume >> state.capacity;
+}
+
+/// what a peer sends to the coordinator at the end of a tick
+struct DomainReport
+{
+    quint32 population = 0;
+    QVector<DomainGhost> ghostsToLower;
+    QVector<DomainGhost> ghostsToUpper;
+    QVector<QPair<qint32, QByteArray>> migrants;
+    QHash<quint32, qreal> volumeChanges;
+    QSet<quint32> depleted;
+    /// agents born here in strips of other ranks
+    QVector<QPointF> spawns;
+};
+
+/// what the coordinator sends back to a peer
+struct DomainReply
+{
+    QVector<DomainGhost> ghosts;
+    QVector<QByteArray> migrants;
+    QVector<QPointF> spawns;
+    QVector<DomainPoiState> pois;
+};
+
+QDataStream& operator<<(QDataStream& stream, const DomainReport& report)
+{
+    return stream << report.population << report.ghostsToLower << report.ghostsToUpper
+                  << report.migrants << report.volumeChanges << report.depleted << report.spawns;
+}
+
+QDataStream& operator>>(QDataStream& stream, DomainReport& report)
+{
+    return stream >> report.population >> report.ghostsToLower >> report.ghostsToUpper
+                  >> report.migrants >> report.volumeChanges >> report.depleted >> report.spawns;
+}
+
+QDataStream& operator<<(QDataStream& stream, const DomainReply& reply)
+{
+    return stream << reply.ghosts << reply.migrants << reply.spawns << reply.pois;
+}
+
+QDataStream& operator>>(QDataStream& stream, DomainReply& reply)
+{
+    return stream >> reply.ghosts >> reply.migrants >> reply.spawns >> reply.pois;
+}
+
+static bool sendFrame(QLocalSocket* socket, const QByteArray& data)
+{
+    QByteArray frame;
+    QDataStream stream(&frame, QIODevice::WriteOnly);
+    stream << data;
+
+    socket->write(frame);
+    while (socket->bytesToWrite() > 0)
+        if (!socket->waitForBytesWritten(DOMAIN_TICK_TIMEOUT_MS))
+            return false;
+    return true;
+}
+
+static bool receiveFrame(QLocalSocket* socket, QByteArray& data)
+{
+    while (socket->bytesAvailable() < (qint64)sizeof(quint32))
+        if (!socket->waitForReadyRead(DOMAIN_TICK_TIMEOUT_MS))
+            return false;
+
+    quint32 length = qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(socket->peek(sizeof(quint32)).constData()));
+    while (socket->bytesAvailable() < (qint64)(sizeof(quint32) + length))
+        if (!socket->waitForReadyRead(DOMAIN_TICK_TIMEOUT_MS))
+            return false;
+
+    socket->read(sizeof(quint32));
+    data = socket->read(length);
+    return true;
+}
+
+template<class T>
+static QByteArray pack(const T& value)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream << value;
+    return data;
+}
+
+template<class T>
+static bool unpack(const QByteArray& data, T& value)
+{
+    QDataStream stream(data);
+    stream >> value;
+    return stream.status() == QDataStream::Ok;
+}
+
+DomainLink::DomainLink(const QString &session, int rank, int count, const QRectF &worldRect)
+    : session(session), domainRank(rank), domainCount(count), worldRect(worldRect)
+{}
+
+DomainLink::~DomainLink()
+{
+    qDeleteAll(peers);
+    delete server;
+}
+
+QRectF DomainLink::area() const
+{
+    qreal width = worldRect.width() / domainCount;
+    return QRectF(worldRect.left() + domainRank * width, worldRect.top(), width, worldRect.height());
+}
+
+int DomainLink::ownerOf(QPointF pos) const
+{
+    int owner = (int)floor((pos.x() - worldRect.left()) * domainCount / worldRect.width());
+    return qBound(0, owner, domainCount - 1);
+}
+
+bool DomainLink::connectPeers()
+{
+    if (isCoordinator())
+    {
+        peers.fill(nullptr, domainCount);
+        server = new QLocalServer;
+        QLocalServer::removeServer(session);
+        if (!server->listen(session))
+            return false;
+
+        for (int connected = 1; connected < domainCount; connected++)
+        {
+            if (!server->waitForNewConnection(DOMAIN_CONNECT_TIMEOUT_MS))
+                return false;
+            QLocalSocket* socket = server->nextPendingConnection();
+            QByteArray hello;
+            qint32 peerRank = -1;
+            if (!receiveFrame(socket, hello) || !unpack(hello, peerRank)
+                    || peerRank <= 0 || peerRank >= domainCount || peers[peerRank])
+                return false;
+            peers[peerRank] = socket;
+        }
+    }
+    else
+    {
+        QLocalSocket* socket = new QLocalSocket;
+        peers.append(socket);
+
+        QElapsedTimer timer;
+        timer.start();
+        do
+        {
+            // coordinator may be not listening yet
+            socket->connectToServer(session);
+            if (socket->waitForConnected(100))
+                break;
+            socket->abort();
+            QThread::msleep(50);
+        } while (timer.elapsed() < DOMAIN_CONNECT_TIMEOUT_MS);
+
+        if (socket->state() != QLocalSocket::ConnectedState)
+            return false;
+        if (!sendFrame(socket, pack((qint32)domainRank)))
+            return false;
+    }
+    return true;
+}
+
+void DomainLink::recordVolumeChange(const WorldObject* poi, qreal delta)
+{
+    QMutexLocker lock(&changesAccess);
+    volumeChanges[poi->serialNumber()] += delta;
+}
+
+void DomainLink::recordDepletion(const WorldObject *poi)
+{
+    QMutexLocker lock(&changesAccess);
+    depleted.insert(poi->serialNumber());
+}
+
+void DomainLink::forwardSpawn(QPointF pos)
+{
+    QMutexLocker lock(&changesAccess);
+    pendingSpawns.append(pos);
+}
+
+void DomainLink::collectGhosts(World& world, QVector<DomainGhost>& toLower, QVector<DomainGhost>& toUpper) const
+{
+    QRectF strip = area();
+    bool hasLower = domainRank > 0;
+    bool hasUpper = domainRank < domainCount - 1;
+
+    world.forEachAgent([&](const Agent* agent)
+    {
+        if (agent->state() == Agent::Dead)
+            return;
+        qreal reach = agent->shoutingRange() + 1;
+        DomainGhost ghost;
+        ghost.pos = agent->pos();
+        ghost.shoutRange = agent->shoutingRange();
+        ghost.distanceToResource = agent->resourceDistance();
+        ghost.distanceToWarehouse = agent->warehouseDistance();
+        if (hasLower && agent->pos().x() - reach < strip.left())
+            toLower.append(ghost);
+        if (hasUpper && agent->pos().x() + reach >= strip.right())
+            toUpper.append(ghost);
+    });
+}
+
+QVector<QPair<qint32, QByteArray>> DomainLink::collectMigrants(World& world) const
+{
+    QVector<QPair<qint32, QByteArray>> migrants;
+    QVector<Agent*> leaving = world.takeAgents([this](const Agent* agent)
+    {
+        return agent->state() != Agent::Dead && !owns(agent->pos());
+    });
+    foreach (Agent* agent, leaving)
+    {
+        QJsonObject json;
+        agent->write(json);
+        migrants.append(qMakePair((qint32)ownerOf(agent->pos()), QJsonDocument(json).toJson(QJsonDocument::Compact)));
+    }
+    return migrants;
+}
+
+bool DomainLink::exchange(World &world)
+{
+    if (domainCount < 2)
+        return true;
+    return isCoordinator() ? exchangeAsCoordinator(world) : exchangeAsPeer(world);
+}
+
+bool DomainLink::exchangeAsPeer(World& world)
+{
+    DomainReport report;
+    report.population = world.aliveAgentsCount();
+    collectGhosts(world, report.ghostsToLower, report.ghostsToUpper);
+    report.migrants = collectMigrants(world);
+    {
+        QMutexLocker lock(&changesAccess);
+        report.volumeChanges.swap(volumeChanges);
+        report.depleted.swap(depleted);
+        report.spawns.swap(pendingSpawns);
+    }
+
+    QByteArray data;
+    DomainReply reply;
+    if (!sendFrame(peers[0], pack(report)) || !receiveFrame(peers[0], data) || !unpack(data, reply))
+        return false;
+
+    world.setGhosts(reply.ghosts);
+    foreach (const QByteArray& migrant, reply.migrants)
+        world.acceptAgent(QJsonDocument::fromJson(migrant).object());
+    foreach (QPointF pos, reply.spawns)
+        world.generateNewAgent(pos);
+    world.applyPoiStates(reply.pois);
+
+    return true;
+}
+
+bool DomainLink::exchangeAsCoordinator(World& world)
+{
+    QVector<DomainReport> reports(domainCount);
+    reports[0].population = world.aliveAgentsCount();
+    collectGhosts(world, reports[0].ghostsToLower, reports[0].ghostsToUpper);
+    reports[0].migrants = collectMigrants(world);
+
+    {
+        // own changes are already applied to the authoritative state
+        QMutexLocker lock(&changesAccess);
+        volumeChanges.clear();
+        depleted.clear();
+        reports[0].spawns.swap(pendingSpawns);
+    }
+
+    for (int rank=1; rank<domainCount; rank++)
+    {
+        QByteArray data;
+        if (!receiveFrame(peers[rank], data) || !unpack(data, reports[rank]))
+            return false;
+    }
+
+    QVector<DomainReply> replies(domainCount);
+    totalPopulation = 0;
+    for (int rank=0; rank<domainCount; rank++)
+    {
+        const DomainReport& report = reports[rank];
+        totalPopulation += report.population;
+
+        if (rank > 0)
+        {
+            world.applyPoiChanges(report.volumeChanges, report.depleted);
+            replies[rank - 1].ghosts += report.ghostsToLower;
+        }
+        if (rank < domainCount - 1)
+            replies[rank + 1].ghosts += report.ghostsToUpper;
+
+        foreach (auto& migrant, report.migrants)
+            replies[migrant.first].migrants.append(migrant.second);
+        foreach (QPointF pos, report.spawns)
+            replies[ownerOf(pos)].spawns.append(pos);
+    }
+
+    QVector<DomainPoiState> pois = world.poiStates();
+    for (int rank=1; rank<domainCount; rank++)
+    {
+        replies[rank].pois = pois;
+        if (!sendFrame(peers[rank], pack(replies[rank])))
+            return false;
+    }
+
+    world.setGhosts(replies[0].ghosts);
+    foreach (const QByteArray& migrant, replies[0].migrants)
+        world.acceptAgent(QJsonDocument::fromJson(migrant).object());
+    foreach (QPointF pos, replies[0].spawns)
+        world.generateNewAgent(pos);
+
+    return true;
+}
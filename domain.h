@@ -0,0 +1,104 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QString>
+#include <QDataStream>
+
+class QLocalServer;
+class QLocalSocket;
+class World;
+class WorldObject;
+
+const int DOMAIN_CONNECT_TIMEOUT_MS = 30000;
+const int DOMAIN_TICK_TIMEOUT_MS = 60000;
+
+/// agent of neighbour domain close enough to the border to be heard here
+struct DomainGhost
+{
+    QPointF pos;
+    qreal shoutRange = 0;
+    qreal distanceToResource = 0;
+    qreal distanceToWarehouse = 0;
+};
+
+/// resource or warehouse as the coordinator sees it
+struct DomainPoiState
+{
+    quint32 serial = 0;
+    bool warehouse = false;
+    bool valid = true;
+    QPointF pos;
+    qreal radius = 0;
+    qreal volume = 0;
+    qreal capacity = 0;
+};
+
+QDataStream& operator<<(QDataStream& stream, const DomainGhost& ghost);
+QDataStream& operator>>(QDataStream& stream, DomainGhost& ghost);
+QDataStream& operator<<(QDataStream& stream, const DomainPoiState& state);
+QDataStream& operator>>(QDataStream& stream, DomainPoiState& state);
+
+/** Link of one process to the others when a single World is split across several local processes.
+
+    Every process owns a vertical strip of the world. Rank 0 is the coordinator: once per tick every other rank
+    sends it agents near the strip borders (ghosts), agents that left the strip, agents born in other strips
+    and volume changes of resources and warehouses. Coordinator merges them into authoritative POI state,
+    routes new agents to the ranks owning their birthplaces and sends every rank its ghosts, incoming agents
+    and the POI state back. Transport is a Unix domain socket (QLocalSocket).
+*/
+class DomainLink
+{
+    QString session;
+    int domainRank;
+    int domainCount;
+    QRectF worldRect;
+
+    QLocalServer* server = nullptr;
+    QVector<QLocalSocket*> peers;
+
+    QMutex changesAccess;
+    QHash<quint32, qreal> volumeChanges;
+    QSet<quint32> depleted;
+    QVector<QPointF> pendingSpawns;
+
+    quint32 totalPopulation = 0;
+
+    void collectGhosts(World& world, QVector<DomainGhost>& toLower, QVector<DomainGhost>& toUpper) const;
+    QVector<QPair<qint32, QByteArray>> collectMigrants(World& world) const;
+
+    bool exchangeAsCoordinator(World& world);
+    bool exchangeAsPeer(World& world);
+
+public:
+    DomainLink(const QString& session, int rank, int count, const QRectF& worldRect);
+    ~DomainLink();
+
+    int rank() const {return domainRank;}
+    int count() const {return domainCount;}
+    bool isCoordinator() const {return domainRank == 0;}
+
+    QRectF area() const;
+    int ownerOf(QPointF pos) const;
+    bool owns(QPointF pos) const {return ownerOf(pos) == domainRank;}
+
+    /// blocking: coordinator waits for all peers, peers connect to the coordinator
+    bool connectPeers();
+
+    void recordVolumeChange(const WorldObject* poi, qreal delta);
+    void recordDepletion(const WorldObject* poi);
+    void forwardSpawn(QPointF pos);
+
+    /// blocking, called by the world once per tick; false if any process is gone
+    bool exchange(World& world);
+
+    /// agents alive in all domains after the last exchange, known to the coordinator only
+    quint32 population() const {return totalPopulation;}
+};
+
+#endif // DOMAIN_H
@@ -0,0 +1,34 @@
+# Runs the same headless world whole and split across domains and compares their summaries:
+# cmake -DSWARM=<swarm executable> -DDOMAINS=2 -DTICKS=300 -DSEED=1 -P domaincheck.cmake
+
+foreach(variable SWARM DOMAINS TICKS SEED)
+    if(NOT DEFINED ${variable})
+        message(FATAL_ERROR "${variable} is not set")
+    endif()
+endforeach()
+
+function(run_summary domains result)
+    execute_process(
+        COMMAND ${SWARM} --headless --fixed-workers --domains ${domains} --ticks ${TICKS} --seed ${SEED}
+        RESULT_VARIABLE exitCode
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE output
+        TIMEOUT 600
+    )
+    if(NOT exitCode EQUAL 0)
+        message(FATAL_ERROR "swarm --domains ${domains} failed (${exitCode}):\n${output}")
+    endif()
+    # the coordinator prints "seed <seed> ticks <ticks> agents <count> (empty <n>, full <n>) warehouse volume <volume>"
+    string(REGEX MATCH "seed [0-9]+ ticks [0-9]+ agents [^\n]*warehouse volume [0-9]+" summary "${output}")
+    if(NOT summary)
+        message(FATAL_ERROR "no summary from swarm --domains ${domains}:\n${output}")
+    endif()
+    set(${result} "${summary}" PARENT_SCOPE)
+endfunction()
+
+run_summary(1 whole)
+run_summary(${DOMAINS} split)
+if(NOT whole STREQUAL split)
+    message(FATAL_ERROR "split world differs\n  1 domain:  ${whole}\n  ${DOMAINS} domains: ${split}")
+endif()
+message(STATUS "${DOMAINS} domains agree: ${split}")
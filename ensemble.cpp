@@ -0,0 +1,139 @@
+#include "ensemble.h"
+#include "world.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QtConcurrent>
+
+#include <stdexcept>
+
+/// scalar or array of scalars as a list of values
+static QJsonArray sweptValues(const QJsonObject& sweep, const QString& key, const QJsonValue& fallback)
+{
+    QJsonValue value = sweep.value(key);
+    if (value.isUndefined() || value.isNull())
+        return QJsonArray({fallback});
+    if (value.isArray())
+        return value.toArray();
+    return QJsonArray({value});
+}
+
+static QSize sizeValue(const QJsonValue& value)
+{
+    if (value.isObject())
+        return QSize(value.toObject()["width"].toInt(), value.toObject()["height"].toInt());
+    QJsonArray pair = value.toArray();
+    return QSize(pair.at(0).toInt(), pair.at(1).toInt());
+}
+
+Ensemble Ensemble::fromSweepFile(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        throw std::runtime_error(QString("can't open sweep file %1").arg(fileName).toStdString());
+
+    QJsonParseError error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+    if (!document.isObject())
+        throw std::runtime_error(QString("sweep file %1: %2").arg(fileName, error.errorString()).toStdString());
+
+    QJsonObject json = document.object();
+    QJsonObject sweep = json["sweep"].toObject();
+    quint64 ticks = json["ticks"].toVariant().toULongLong();
+    quint32 firstSeed = json["seed"].toVariant().toUInt();
+    int repeats = qMax(1, json["repeats"].toInt(1));
+
+    QJsonArray agents = sweptValues(sweep, "agents", AGENTS_COUNT);
+    QJsonArray ranges = sweptValues(sweep, "shout_range", DEFAULT_AGENT_SHOUT_RANGE);
+    QJsonArray prices = sweptValues(sweep, "agent_price", (int)NEW_AGENT_RESOURCES_PRICE);
+    QJsonArray sizes = sweep["world_size"].toArray();
+    // a single [width, height] pair is not a list of sizes
+    if (sizes.isEmpty() || !(sizes.first().isArray() || sizes.first().isObject()))
+        sizes = QJsonArray({sizes.isEmpty() ? QJsonArray({DEFAULT_WORLD_SIZE.width(), DEFAULT_WORLD_SIZE.height()})
+                                            : sizes});
+
+    Ensemble ensemble;
+    foreach (const QJsonValue& size, sizes)
+        foreach (const QJsonValue& count, agents)
+            foreach (const QJsonValue& range, ranges)
+                foreach (const QJsonValue& price, prices)
+                    for (int repeat=0; repeat<repeats; repeat++)
+                    {
+                        EnsembleRun run;
+                        run.index = ensemble.runs.count();
+                        run.seed = firstSeed + run.index;
+                        run.ticks = ticks ? ticks : 10000;
+                        run.agents = count.toInt();
+                        run.shoutRange = range.toDouble();
+                        run.newAgentPrice = price.toInt();
+                        run.worldSize = sizeValue(size);
+                        if (run.worldSize.isEmpty() || run.agents < 0 || run.shoutRange <= 0 || !run.newAgentPrice)
+                            throw std::runtime_error(QString("sweep file %1: invalid parameters of run %2")
+                                                     .arg(fileName).arg(run.index).toStdString());
+                        ensemble.runs.append(run);
+                    }
+    return ensemble;
+}
+
+QStringList Ensemble::csvHeader()
+{
+    return {"run", "seed", "ticks", "agents", "shout_range", "agent_price", "world_width", "world_height",
+            "elapsed_ms", "alive_agents", "empty_agents", "full_agents", "births", "deaths",
+            "resources_delivered", "warehouse_volume", "mean_ttl"};
+}
+
+bool Ensemble::run(const QString& csvFileName)
+{
+    QFile file(csvFileName);
+    bool opened = false;
+    if (csvFileName == "-")
+        opened = file.open(stdout, QIODevice::WriteOnly);
+    else
+        opened = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (!opened)
+    {
+        qWarning("can't write %s", qPrintable(csvFileName));
+        return false;
+    }
+
+    QMutex csvAccess;
+    QTextStream csv(&file);
+    csv << csvHeader().join(',') << '\n';
+    csv.flush();
+
+    QtConcurrent::blockingMap(runs, [&](const EnsembleRun& run)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        World world;
+        world.setSeed(run.seed);
+        world.setWorldSize(run.worldSize);
+        world.setAgentShoutRange(run.shoutRange);
+        world.setNewAgentPrice(run.newAgentPrice);
+        world.setInitialAgentsCount(run.agents);
+        world.onStart();
+        world.runUntil(run.ticks);
+
+        WorldStats stats = world.stats();
+        QStringList row = {QString::number(run.index), QString::number(run.seed), QString::number(stats.tick),
+                           QString::number(run.agents), QString::number(run.shoutRange),
+                           QString::number(run.newAgentPrice),
+                           QString::number(run.worldSize.width()), QString::number(run.worldSize.height()),
+                           QString::number(timer.elapsed()), QString::number(stats.agentsCount()),
+                           QString::number(stats.emptyAgentsCount), QString::number(stats.fullAgentsCount),
+                           QString::number(stats.totalBirths), QString::number(stats.totalDeaths),
+                           QString::number(stats.totalResourcesDelivered, 'f', 1),
+                           QString::number(stats.warehouseVolume, 'f', 1), QString::number(stats.meanTtl, 'f', 1)};
+
+        QMutexLocker lock(&csvAccess);
+        csv << row.join(',') << '\n';
+        csv.flush();
+    });
+    return true;
+}
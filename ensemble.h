@@ -0,0 +1,48 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <QString>
+#include <QSize>
+#include <QVector>
+#include <QStringList>
+
+/// parameters of one world of an ensemble
+struct EnsembleRun
+{
+    int index = 0;
+    quint32 seed = 0;
+    quint64 ticks = 0;
+    int agents = 0;
+    qreal shoutRange = 0;
+    quint32 newAgentPrice = 0;
+    QSize worldSize;
+};
+
+/** Many independent worlds in one process, for parameter sweeps.
+
+    Sweep file is JSON:
+    {
+        "ticks": 10000, "seed": 1, "repeats": 3,
+        "sweep": {"agents": [500, 5000], "shout_range": [30, 50], "agent_price": 77, "world_size": [[800, 800]]}
+    }
+    Every combination of swept values is run "repeats" times, run i gets seed "seed" + i. Missing values are the
+    usual defaults. Worlds are run as tasks of the global thread pool, each ticks on a pool of its own and
+    tunes its worker count like a single world does. Every finished run appends a summary row to the CSV
+*/
+class Ensemble
+{
+    QVector<EnsembleRun> runs;
+
+public:
+    /// throws std::runtime_error if the sweep file can't be read
+    static Ensemble fromSweepFile(const QString& fileName);
+
+    const QVector<EnsembleRun>& plannedRuns() const {return runs;}
+
+    static QStringList csvHeader();
+
+    /// blocking; rows are written in order of completion, "-" writes to stdout
+    bool run(const QString& csvFileName);
+};
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,62 @@
+#include "epochreclaimer.h"
+
+#include <QThread>
+
+EpochReclaimer::EpochReclaimer()
+{
+    for (std::atomic<quint64>& slot : slots)
+        slot.store(EPOCH_IDLE);
+}
+
+int EpochReclaimer::occupy(quint64 epoch)
+{
+    for (int i=0; i<EPOCH_READER_SLOTS; i++)
+    {
+        quint64 idle = EPOCH_IDLE;
+        if (slots[i].compare_exchange_strong(idle, epoch))
+            return i;
+    }
+    return -1;
+}
+
+int EpochReclaimer::registerReader()
+{
+    return occupy(0);
+}
+
+void EpochReclaimer::unregisterReader(int slot)
+{
+    if (slot >= 0)
+        slots[slot].store(EPOCH_IDLE);
+}
+
+void EpochReclaimer::readerAt(int slot, quint64 epoch)
+{
+    if (slot >= 0)
+        slots[slot].store(epoch);
+}
+
+quint64 EpochReclaimer::oldestReader() const
+{
+    quint64 oldest = EPOCH_IDLE;
+    for (const std::atomic<quint64>& slot : slots)
+        oldest = qMin(oldest, slot.load());
+    return oldest;
+}
+
+EpochGuard::EpochGuard(EpochReclaimer& reclaimer)
+    : reclaimer(reclaimer)
+{
+    // slot holding 0 blocks any reclamation until the real epoch is known
+    while ((slot = reclaimer.occupy(0)) < 0)
+        QThread::yieldCurrentThread();
+
+    // whatever was published for the previous epoch may still be taken after this point
+    quint64 epoch = reclaimer.epoch();
+    reclaimer.slots[slot].store(epoch ? epoch - 1 : 0);
+}
+
+EpochGuard::~EpochGuard()
+{
+    reclaimer.slots[slot].store(EPOCH_IDLE);
+}
@@ -0,0 +1,83 @@
+#ifndef EPOCHRECLAIMER_H
+#define EPOCHRECLAIMER_H
+
+#include <QVector>
+#include <QPair>
+
+#include <atomic>
+
+const int EPOCH_READER_SLOTS = 64;
+/// value of a reader slot nobody occupies
+const quint64 EPOCH_IDLE = ~Q_UINT64_C(0);
+
+/** Epoch based reclamation of objects removed from the world.
+
+    Epoch is the world tick. Objects leaving the world are retired with the epoch they left in and deleted
+    once no reader can hold them any more. Readers never lock: a long-lived reader (the GUI) registers a slot
+    and reports the oldest epoch it may still hold objects of, a short read pins the current epoch with EpochGuard.
+    The world thread takes the minimum over all slots when it frees retired objects
+*/
+class EpochReclaimer
+{
+    std::atomic<quint64> current {0};
+    std::atomic<quint64> slots[EPOCH_READER_SLOTS];
+
+    int occupy(quint64 epoch);
+
+public:
+    EpochReclaimer();
+
+    /// world thread only, after publishing everything readers of the new epoch may take
+    void advance(quint64 epoch) {current.store(epoch);}
+    quint64 epoch() const {return current.load();}
+
+    /// slot of a reader that holds everything until its first readerAt(), -1 if all slots are taken
+    int registerReader();
+    void unregisterReader(int slot);
+    /// reader holds no objects retired before epoch
+    void readerAt(int slot, quint64 epoch);
+
+    /// oldest epoch some reader may still hold objects of, EPOCH_IDLE if there are no readers
+    quint64 oldestReader() const;
+
+    friend class EpochGuard;
+};
+
+/// pins the current epoch for a short read on any thread
+class EpochGuard
+{
+    EpochReclaimer& reclaimer;
+    int slot;
+
+public:
+    EpochGuard(EpochReclaimer& reclaimer);
+    ~EpochGuard();
+};
+
+/// objects retired in epoch order and deleted once no reader holds them
+template<class T> class RetiredList
+{
+    QVector<QPair<quint64, T*>> objects;
+
+public:
+    ~RetiredList()
+    {
+        for (const QPair<quint64, T*>& o : objects)
+            delete o.second;
+    }
+
+    void append(quint64 epoch, T* object) {objects.append(qMakePair(epoch, object));}
+    int count() const {return objects.count();}
+
+    /// delete objects retired before safeEpoch, returns how many
+    int reclaim(quint64 safeEpoch)
+    {
+        int n = 0;
+        while (n < objects.count() && objects[n].first < safeEpoch)
+            delete objects[n++].second;
+        objects.remove(0, n);
+        return n;
+    }
+};
+
+#endif // EPOCHRECLAIMER_H
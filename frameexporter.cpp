@@ -0,0 +1,92 @@
+#include "frameexporter.h"
+#include "snapshotpainter.h"
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QtConcurrent>
+
+FrameExporter::FrameExporter(const QString& directory, const QRectF& worldRect, int every, ExportFormat format, int width)
+    : directory(directory), worldRect(worldRect), every(qMax(1, every)), format(format)
+{
+    width = qMax(16, width);
+    imageSize = QSize(width, qMax(16, qRound(width * worldRect.height() / worldRect.width())));
+    capacity = pool.maxThreadCount() * EXPORT_QUEUE_PER_THREAD;
+}
+
+FrameExporter::~FrameExporter()
+{
+    pool.waitForDone();
+}
+
+bool FrameExporter::create()
+{
+    if (!QDir().mkpath(directory))
+    {
+        error = QString("can't create %1").arg(directory);
+        return false;
+    }
+    return true;
+}
+
+bool FrameExporter::reserve()
+{
+    if (inFlight.fetch_add(1) >= capacity)
+    {
+        inFlight--;
+        droppedCount++;
+        return false;
+    }
+    return true;
+}
+
+void FrameExporter::submit(const ExportFrame& frame)
+{
+    QtConcurrent::run(&pool, [this, frame]()
+    {
+        render(frame);
+        inFlight--;
+    });
+}
+
+void FrameExporter::render(const ExportFrame& frame)
+{
+    QImage image(imageSize, format == ExportFormat::Raw ? QImage::Format_RGBA8888 : QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::white);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    fitWorld(painter, worldRect, imageSize, 0);
+    paintSnapshot(painter, worldRect, frame.snapshot);
+    if (commLines)
+    {
+        // as MainWindow draws them
+        QColor red(EMPTY_AGENT_COLOR);
+        QColor green(FULL_AGENT_COLOR);
+        red.setAlphaF(0.2);
+        green.setAlphaF(0.2);
+        painter.setPen(QPen(red, 2));
+        painter.drawLines(frame.emptyLines);
+        painter.setPen(QPen(green, 2));
+        painter.drawLines(frame.fullLines);
+    }
+    painter.end();
+
+    QString name = QString("%1/frame_%2").arg(directory).arg(frame.snapshot.tick, 8, 10, QChar('0'));
+    bool saved = false;
+    if (format == ExportFormat::Png)
+        saved = image.save(name + ".png", "PNG");
+    else
+    {
+        QFile file(name + ".rgba");
+        int rowBytes = image.width() * 4;
+        saved = file.open(QIODevice::WriteOnly);
+        for (int y = 0; saved && y < image.height(); y++)
+            saved = file.write((const char*)image.constScanLine(y), rowBytes) == rowBytes;
+    }
+
+    if (saved)
+        writtenCount++;
+    else
+        failedCount++;
+}
@@ -0,0 +1,81 @@
+#ifndef FRAMEEXPORTER_H
+#define FRAMEEXPORTER_H
+
+#include "sharedsnapshot.h"
+
+#include <QThreadPool>
+#include <QLineF>
+#include <QSize>
+#include <QString>
+
+#include <atomic>
+
+const int EXPORT_DEFAULT_WIDTH = 1024;
+/// frames queued or being drawn per worker thread, more are dropped
+const int EXPORT_QUEUE_PER_THREAD = 2;
+
+enum class ExportFormat {Png, Raw};
+
+/// what is drawn into one exported image
+struct ExportFrame
+{
+    WorldSnapshot snapshot;
+    /// communication lines of empty and full agents
+    QVector<QLineF> emptyLines;
+    QVector<QLineF> fullLines;
+};
+
+/** Draws world snapshots into images and writes them as frame_<tick>.png or .rgba files.
+
+    Frames are drawn and written by a pool of its own, at most EXPORT_QUEUE_PER_THREAD per thread at once.
+    Nothing ever waits for the pool: a frame due while the queue is full is dropped and counted, so a slow disk
+    costs frames, not ticks. Raw frames are tightly packed RGBA rows, e.g. for ffmpeg -f rawvideo -pix_fmt rgba
+*/
+class FrameExporter
+{
+    QString directory;
+    QRectF worldRect;
+    QSize imageSize;
+    int every;
+    ExportFormat format;
+    bool commLines = false;
+    QString error;
+
+    QThreadPool pool;
+    int capacity;
+    std::atomic<int> inFlight {0};
+    std::atomic<quint64> writtenCount {0};
+    std::atomic<quint64> droppedCount {0};
+    std::atomic<quint64> failedCount {0};
+
+    void render(const ExportFrame& frame);
+
+public:
+    FrameExporter(const QString& directory, const QRectF& worldRect, int every = 1,
+                  ExportFormat format = ExportFormat::Png, int width = EXPORT_DEFAULT_WIDTH);
+    /// waits for the frames in flight
+    ~FrameExporter();
+
+    /// creates the directory
+    bool create();
+    QString errorString() const {return error;}
+    QSize frameSize() const {return imageSize;}
+
+    void setCommLines(bool on) {commLines = on;}
+    bool wantsCommLines() const {return commLines;}
+
+    /// every-th tick is exported
+    bool due(quint64 tick) const {return tick % every == 0;}
+    /// takes a place in the queue for the next frame, false if it's full and the frame is dropped
+    bool reserve();
+    /// frame for the place taken by reserve()
+    void submit(const ExportFrame& frame);
+    void waitForDone() {pool.waitForDone();}
+
+    quint64 written() const {return writtenCount;}
+    quint64 dropped() const {return droppedCount;}
+    /// frames that couldn't be written
+    quint64 failed() const {return failedCount;}
+};
+
+#endif // FRAMEEXPORTER_H
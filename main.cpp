@@ -1,13 +1,306 @@
 #include "mainwindow.h"
 #include "world.h"
+#include "metricsserver.h"
+#include "ensemble.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+#include <QCommandLineParser>
 #include <QLocale>
 #include <QTranslator>
 #include <QThread>
+#include <QProcess>
+#include <QScopedPointer>
+#include <QFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+static bool isHeadlessRun(int argc, char *argv[])
+{
+    for (int i=1; i<argc; i++)
+    {
+        QByteArray arg(argv[i]);
+        if (arg == "--headless" || arg.startsWith("--domains") || arg.startsWith("--ensemble"))
+            return true;
+    }
+    return false;
+}
+
+static int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption headlessOption("headless", "Run simulation without GUI");
+    QCommandLineOption ticksOption("ticks", "Number of ticks to simulate", "count", "10000");
+    QCommandLineOption seedOption("seed", "Random seed of the world", "seed");
+    QCommandLineOption domainsOption("domains", "Split the world across <count> local processes", "count", "1");
+    QCommandLineOption rankOption("domain-rank", "Rank of this process in a split world (set by the coordinator)", "rank", "0");
+    QCommandLineOption sessionOption("domain-session", "Name of a split world session (set by the coordinator)", "name");
+    QCommandLineOption stateOption("state-out", "Save final world state to <file>", "file");
+    QCommandLineOption agentsOption("agents", "Initial number of agents", "count", QString::number(AGENTS_COUNT));
+    QCommandLineOption separationOption("separation", "Agents push each other apart instead of passing through");
+    QCommandLineOption reorderOption("reorder-agents", "Keep agents sorted by position along a Morton curve");
+    QCommandLineOption incrementalOption("incremental-shouting", "Acoustic field persists between ticks, agents shout only news");
+    QCommandLineOption communicationOption("communication", "How agents share distances: acoustic or diffusion", "model", "acoustic");
+    QCommandLineOption scenarioOption("scenario", "Start from a scenario or saved state <file>, its parameters win", "file");
+    QCommandLineOption tickRateOption("tick-rate", "Paced mode: start ticks on deadlines <rate> per second", "rate");
+    QCommandLineOption fixedWorkersOption("fixed-workers", "Keep default worker count and chunk size instead of autotuning them");
+    QCommandLineOption metricsOption("metrics-port", "Serve Prometheus metrics on localhost:<port> (split world peers use port + rank)", "port");
+    QCommandLineOption ensembleOption("ensemble", "Run every world of a parameter sweep described in <file>", "file");
+    QCommandLineOption csvOption("csv", "Write ensemble summary rows to <file> (stdout by default)", "file", "-");
+    QCommandLineOption shareOption("share", "Publish world snapshots in shared memory <name> for swarm-viewer", "name");
+    QCommandLineOption shareCapacityOption("share-capacity", "Most agents in a shared snapshot", "count",
+                                           QString::number(SNAPSHOT_DEFAULT_AGENT_CAPACITY));
+    QCommandLineOption exportOption("export-frames", "Draw ticks offscreen into image files in <directory>", "directory");
+    QCommandLineOption exportEveryOption("export-every", "Export every <n>th tick", "n", "1");
+    QCommandLineOption exportFormatOption("export-format", "Exported frames are png or raw RGBA", "format", "png");
+    QCommandLineOption exportWidthOption("export-width", "Width of exported frames in pixels", "pixels",
+                                         QString::number(EXPORT_DEFAULT_WIDTH));
+    QCommandLineOption exportLinesOption("export-comm-lines", "Draw communication lines into exported frames");
+    QCommandLineOption trafficOption("traffic-map", "Count where empty and full agents go, save the counts to <file> at the end", "file");
+    parser.addOptions({headlessOption, ticksOption, seedOption, domainsOption, rankOption, sessionOption, stateOption,
+                       agentsOption, separationOption, reorderOption, incrementalOption, communicationOption, scenarioOption, tickRateOption, fixedWorkersOption, metricsOption, ensembleOption, csvOption,
+                       shareOption, shareCapacityOption, exportOption, exportEveryOption, exportFormatOption,
+                       exportWidthOption, exportLinesOption, trafficOption});
+    parser.process(app);
+
+    if (parser.isSet(ensembleOption))
+    {
+        try
+        {
+            Ensemble ensemble = Ensemble::fromSweepFile(parser.value(ensembleOption));
+            return ensemble.run(parser.value(csvOption)) ? 0 : 1;
+        }
+        catch (const std::runtime_error& e)
+        {
+            qWarning("%s", e.what());
+            return 1;
+        }
+    }
+
+    quint64 ticks = parser.value(ticksOption).toULongLong();
+    int domainsCount = qMax(1, parser.value(domainsOption).toInt());
+    int rank = parser.value(rankOption).toInt();
+    QString session = parser.isSet(sessionOption) ? parser.value(sessionOption)
+                                                  : QString("swarm-%1").arg(QCoreApplication::applicationPid());
+    quint32 seed = parser.isSet(seedOption) ? parser.value(seedOption).toUInt()
+                                            : QRandomGenerator::system()->generate();
+
+    World world;
+    world.setSeed(seed);
+    world.setInitialAgentsCount(parser.value(agentsOption).toInt());
+    world.setAgentSeparation(parser.isSet(separationOption));
+    world.setLocalityReordering(parser.isSet(reorderOption));
+    world.setIncrementalShouting(parser.isSet(incrementalOption));
+    world.setAutotuning(!parser.isSet(fixedWorkersOption));
+    world.setTickRate(parser.value(tickRateOption).toDouble());
+    world.setTrafficRecording(parser.isSet(trafficOption));
+    if (parser.value(communicationOption) == "diffusion")
+        world.setCommunicationModel(CommunicationModel::Diffusion);
+    else if (parser.value(communicationOption) != "acoustic")
+        qWarning("unknown communication model %s, using acoustic", qPrintable(parser.value(communicationOption)));
+
+    if (parser.isSet(scenarioOption))
+    {
+        if (domainsCount > 1)
+        {
+            qWarning("a scenario can't be loaded into a split world");
+            return 1;
+        }
+        try
+        {
+            world.loadScenario(parser.value(scenarioOption));
+        }
+        catch (const std::runtime_error& e)
+        {
+            qWarning("%s", e.what());
+            return 1;
+        }
+    }
+
+    QScopedPointer<DomainLink> domain;
+    QVector<QProcess*> peers;
+    if (domainsCount > 1)
+    {
+        domain.reset(new DomainLink(session, rank, domainsCount, world.boundRect()));
+        world.setDomain(domain.data());
+
+        if (domain->isCoordinator())
+        {
+            for (int peerRank=1; peerRank<domainsCount; peerRank++)
+            {
+                QStringList arguments = {"--headless",
+                                         "--ticks", QString::number(ticks),
+                                         "--seed", QString::number(seed),
+                                         "--domains", QString::number(domainsCount),
+                                         "--domain-rank", QString::number(peerRank),
+                                         "--domain-session", session,
+                                         "--agents", parser.value(agentsOption)};
+                if (parser.isSet(stateOption))
+                    arguments << "--state-out" << parser.value(stateOption);
+                if (parser.isSet(separationOption))
+                    arguments << "--separation";
+                if (parser.isSet(reorderOption))
+                    arguments << "--reorder-agents";
+                if (parser.isSet(incrementalOption))
+                    arguments << "--incremental-shouting";
+                if (parser.isSet(fixedWorkersOption))
+                    arguments << "--fixed-workers";
+                if (parser.isSet(tickRateOption))
+                    arguments << "--tick-rate" << parser.value(tickRateOption);
+                arguments << "--communication" << parser.value(communicationOption);
+                if (parser.isSet(metricsOption))
+                    arguments << "--metrics-port" << parser.value(metricsOption);
+                if (parser.isSet(shareOption))
+                    arguments << "--share" << parser.value(shareOption)
+                              << "--share-capacity" << parser.value(shareCapacityOption);
+                if (parser.isSet(exportOption))
+                    arguments << "--export-frames" << parser.value(exportOption)
+                              << "--export-every" << parser.value(exportEveryOption)
+                              << "--export-format" << parser.value(exportFormatOption)
+                              << "--export-width" << parser.value(exportWidthOption);
+                if (parser.isSet(exportLinesOption))
+                    arguments << "--export-comm-lines";
+                if (parser.isSet(trafficOption))
+                    arguments << "--traffic-map" << parser.value(trafficOption);
+
+                QProcess* peer = new QProcess;
+                peer->setProcessChannelMode(QProcess::ForwardedChannels);
+                peer->start(QCoreApplication::applicationFilePath(), arguments);
+                peers.append(peer);
+            }
+        }
+    }
+
+    QScopedPointer<SnapshotPublisher> snapshots;
+    if (parser.isSet(shareOption))
+    {
+        // every process of a split world shares its own strip
+        QString name = parser.value(shareOption) + (domain && domain->rank() ? QString(".%1").arg(domain->rank()) : QString());
+        snapshots.reset(new SnapshotPublisher(name, parser.value(shareCapacityOption).toInt()));
+        if (snapshots->create(world.boundRect()))
+            world.setSnapshotPublisher(snapshots.data());
+        else
+            qWarning("can't share world snapshots as %s: %s", qPrintable(name), qPrintable(snapshots->errorString()));
+    }
+
+    QScopedPointer<FrameExporter> exporter;
+    if (parser.isSet(exportOption))
+    {
+        QString directory = parser.value(exportOption) + (domain && domain->rank() ? QString(".%1").arg(domain->rank()) : QString());
+        ExportFormat format = ExportFormat::Png;
+        if (parser.value(exportFormatOption) == "raw")
+            format = ExportFormat::Raw;
+        else if (parser.value(exportFormatOption) != "png")
+            qWarning("unknown frame format %s, using png", qPrintable(parser.value(exportFormatOption)));
+        exporter.reset(new FrameExporter(directory, world.boundRect(), parser.value(exportEveryOption).toInt(), format,
+                                         parser.value(exportWidthOption).toInt()));
+        exporter->setCommLines(parser.isSet(exportLinesOption));
+        if (exporter->create())
+            world.setFrameExporter(exporter.data());
+        else
+            qWarning("can't export frames: %s", qPrintable(exporter->errorString()));
+    }
+
+    QThread worldThread;
+    world.moveToThread( &worldThread);
+    worldThread.connect (&worldThread, &QThread::started, &world, &World::onStart);
+    QMetaObject::invokeMethod(&world, "runUntil", Qt::QueuedConnection, Q_ARG(quint64, ticks));
+
+    // scrapes are served apart from both the world and the main thread
+    QThread metricsThread;
+    QScopedPointer<MetricsServer> metrics;
+    if (parser.isSet(metricsOption))
+    {
+        quint16 port = parser.value(metricsOption).toUShort() + (domain ? domain->rank() : 0);
+        metrics.reset(new MetricsServer(world));
+        metrics->moveToThread(&metricsThread);
+        QMetaObject::invokeMethod(metrics.data(), "listen", Qt::QueuedConnection, Q_ARG(quint16, port));
+        metricsThread.start();
+    }
+
+    QObject::connect (&world, &World::finished, &app, [&]()
+    {
+        if (!domain || domain->isCoordinator())
+        {
+            WorldSummary summary = world.summary();
+            quint32 population = domain ? domain->population() : summary.agentsCount;
+            qInfo("seed %u ticks %llu agents %u (empty %d, full %d) warehouse volume %.0f",
+                  seed, (unsigned long long)summary.tick, population,
+                  summary.emptyAgentsCount, summary.fullAgentsCount, summary.warehouseVolume);
+        }
+        if (exporter)
+        {
+            exporter->waitForDone();
+            QSize size = exporter->frameSize();
+            qInfo("exported %llu frames of %dx%d, %llu dropped, %llu failed", (unsigned long long)exporter->written(),
+                  size.width(), size.height(), (unsigned long long)exporter->dropped(),
+                  (unsigned long long)exporter->failed());
+        }
+        const TickPacer& pacing = world.pacing();
+        if (pacing.isPaced())
+            qInfo("paced at %.1f ticks/s: %llu of %llu ticks late, %llu resyncs, lateness p50 < %.3f ms p99 < %.3f ms",
+                  pacing.rate(), (unsigned long long)pacing.missed(), (unsigned long long)pacing.released(),
+                  (unsigned long long)pacing.resyncs(),
+                  pacing.latenessPercentileNs(0.5) / 1e6, pacing.latenessPercentileNs(0.99) / 1e6);
+        if (parser.isSet(trafficOption))
+        {
+            // every process of a split world counts its own strip
+            QString fileName = parser.value(trafficOption) + (domain && domain->rank() ? QString(".%1").arg(domain->rank()) : QString());
+            const TrafficMap& traffic = world.traffic();
+            if (traffic.save(fileName))
+                qInfo("traffic of %llu ticks in %dx%d cells saved to %s", (unsigned long long)traffic.sampledTicks(),
+                      traffic.columnsCount(), traffic.rowsCount(), qPrintable(fileName));
+            else
+                qWarning("can't save traffic map to %s", qPrintable(fileName));
+        }
+        foreach (const QString& line, MemoryAccounting::report().split('\n'))
+            qInfo("%s", qPrintable(line));
+        if (parser.isSet(stateOption))
+        {
+            QString fileName = parser.value(stateOption);
+            if (domain)
+                fileName += QString(".%1").arg(domain->rank());
+            QFile file(fileName);
+            if (file.open(QIODevice::WriteOnly))
+            {
+                QJsonObject json;
+                world.write(json);
+                file.write(QJsonDocument(json).toJson());
+            }
+        }
+        worldThread.quit();
+        app.quit();
+    });
+
+    worldThread.start();
+    int ret = app.exec();
+    worldThread.wait();
+
+    if (metrics)
+    {
+        // server and its sockets have to be deleted in their own thread
+        metrics->deleteLater();
+        metrics.take();
+        metricsThread.quit();
+        metricsThread.wait();
+    }
+
+    foreach (QProcess* peer, peers)
+    {
+        peer->waitForFinished(-1);
+        delete peer;
+    }
+    return ret;
+}
 
 int main(int argc, char *argv[])
 {
+    if (isHeadlessRun(argc, argv))
+        return runHeadless(argc, argv);
+
     QApplication a(argc, argv);
 
     QTranslator translator;
@@ -19,7 +312,28 @@ int main(int argc, char *argv[])
             break;
         }
     }
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption scenarioOption("scenario", "Start from a scenario or saved state <file>", "file");
+    QCommandLineOption tickRateOption("tick-rate", "Paced mode: start ticks on deadlines <rate> per second", "rate");
+    parser.addOptions({scenarioOption, tickRateOption});
+    parser.process(a);
+
     World world;
+    world.setTickRate(parser.value(tickRateOption).toDouble());
+    if (parser.isSet(scenarioOption))
+    {
+        try
+        {
+            world.loadScenario(parser.value(scenarioOption));
+        }
+        catch (const std::runtime_error& e)
+        {
+            qWarning("%s", e.what());
+            return 1;
+        }
+    }
+
     QThread worldThread;
     world.moveToThread( &worldThread);
     worldThread.connect (&worldThread, &QThread::started, &world, &World::onStart);
@@ -4,13 +4,18 @@
 #include "agent.h"
 
 #include <QGraphicsItem>
+#include <QGraphicsPixmapItem>
+#include <QFileDialog>
 #include <QDataStream>
 #include <QFile>
 #include <QElapsedTimer>
+#include <QLocale>
 
 #include <QJsonObject>
 #include <QJsonDocument>
 
+const qint64 ACOUSTIC_FIELD_REFRESH_MS = 250;
+
 MainWindow::MainWindow(World &world, QWidget *parent)
     : QDialog(parent),
       world(world),
@@ -37,19 +42,74 @@ MainWindow::MainWindow(World &world, QWidget *parent)
     scene->addEllipse(-502,  498, 5, 5, QPen("red"), QBrush("blue"));
     scene->addEllipse( 498,  -502, 5, 5, QPen("red"), QBrush("blue"));
 
-    connect (&world, &World::agentCreated, this, &MainWindow::onAgentCreated);
-    connect (&world, &World::agentDied, this, &MainWindow::onAgentDied, Qt::QueuedConnection);
+    reclamationReader = world.reclamation().registerReader();
+    ui->perfPanel->watch(world.tickSamples());
+    connect (&world, &World::agentsChanged, this, &MainWindow::onAgentsChanged, Qt::QueuedConnection);
     connect (&world, &World::resourceAppeared, this, &MainWindow::onResourceAppeared);
     connect (&world, &World::warehouseAppeared, this, &MainWindow::onWarehouseAppeared);
     connect (&world, &World::resourceDepleted, this, &MainWindow::onResourceDepleted);
     connect (&world, &World::iterationEnd, this, &MainWindow::drawFrame);
     connect (&world, &World::iterationStart, this, &MainWindow::removeCommunicationLines);
     connect (this, &MainWindow::readyForNewFrame, &world, &World::iteration);
+    connect (this, &MainWindow::fastForwardRequest, &world, &World::advance);
+    connect (&world, &World::advanced, this, &MainWindow::onAdvanced);
+    connect (ui->fastForwardButton, &QPushButton::clicked, this, &MainWindow::onFastForwardClicked);
+    connect (ui->agentSeparationCheckbox, &QCheckBox::toggled, this, [this](bool on)
+    {
+        world.setAgentSeparation(on);
+    });
+    connect (ui->localityReorderingCheckbox, &QCheckBox::toggled, this, [this](bool on)
+    {
+        world.setLocalityReordering(on);
+    });
+    connect (ui->incrementalShoutingCheckbox, &QCheckBox::toggled, this, [this](bool on)
+    {
+        world.setIncrementalShouting(on);
+    });
+    connect (ui->diffusionFieldCheckbox, &QCheckBox::toggled, this, [this](bool on)
+    {
+        world.setCommunicationModel(on ? CommunicationModel::Diffusion : CommunicationModel::Acoustic);
+    });
     ui->graphicsView->setScene(scene);
+
+    acousticFieldItem = scene->addPixmap(QPixmap());
+    acousticFieldItem->setPos(worldBorder.topLeft());
+    acousticFieldItem->setZValue(-1);
+    acousticFieldItem->hide();
+    connect (ui->showAcousticFieldCheckbox, &QCheckBox::toggled, this, [this](bool on)
+    {
+        acousticFieldItem->setVisible(on);
+        acousticFieldRefreshTimer.invalidate();
+    });
+    connect (ui->acousticFieldCombo, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, [this]()
+    {
+        acousticFieldRefreshTimer.invalidate();
+    });
+
+    trafficMapItem = scene->addPixmap(QPixmap());
+    trafficMapItem->setPos(worldBorder.topLeft());
+    trafficMapItem->setZValue(-2);
+    trafficMapItem->hide();
+    connect (ui->showTrafficMapCheckbox, &QCheckBox::toggled, this, [this](bool on)
+    {
+        // counting starts when the map is first shown and goes on while it's hidden
+        if (on)
+            world.setTrafficRecording(true);
+        trafficMapItem->setVisible(on);
+        trafficMapRefreshTimer.invalidate();
+        updateTrafficMap();
+    });
+    connect (ui->trafficMapCombo, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, [this]()
+    {
+        trafficMapRefreshTimer.invalidate();
+        updateTrafficMap();
+    });
+    connect (ui->exportTrafficMapButton, &QPushButton::clicked, this, &MainWindow::onExportTrafficMapClicked);
 }
 
 MainWindow::~MainWindow()
 {
+    world.reclamation().unregisterReader(reclamationReader);
     delete ui;
 }
 
@@ -80,28 +140,31 @@ void MainWindow::onResourceDepleted(WorldObject *poi)
         poi->avatar()->destroy();
 }
 
-void MainWindow::onAgentCreated(Agent *a)
-{
-    a->buildAvatar(scene);
-
-    ui->agentsCountLabel->setNum(++agentsCreatedCount);
-}
-
-void MainWindow::onAgentDied(Agent *a)
+void MainWindow::onAgentsChanged(AgentLifecycle changes)
 {
-    a->avatar()->destroy();
-    ui->agentsCountLabel->setNum( --agentsCreatedCount);
+    // agent born and died within one batch gets its avatar built and destroyed here
+    foreach (Agent* a, changes.created)
+        a->buildAvatar(scene);
+    foreach (Agent* a, changes.died)
+        a->avatar()->destroy();
+
+    agentsCreatedCount += changes.created.count();
+    agentsCreatedCount -= changes.died.count();
+    ui->agentsCountLabel->setNum((int)agentsCreatedCount);
+    // events before this batch are all handled, while batches behind it still hold pointers the world retired
+    world.reclamation().readerAt(reclamationReader, changes.tick);
 }
 
 void MainWindow::drawFrame(qint64 calcTime)
 {
+    // tick times come to the performance panel from the world itself
+    Q_UNUSED(calcTime);
     save();
 
     QElapsedTimer renderTimer;
     renderTimer.start();
-    quint16 fullAgentsCount = 0;
-    quint16 emptyAgentsCount = 0;
-    world.forEachAgent([&fullAgentsCount, &emptyAgentsCount](Agent* agent)
+    // the world waits for this frame, the published list is the one it just finished
+    world.forEachAgentReadOnly([](const Agent* agent)
     {
         if (agent->avatar()->valid)
         {
@@ -110,15 +173,10 @@ void MainWindow::drawFrame(qint64 calcTime)
 
             agent->avatar()->setBrush(agent->color());
             agent->avatar()->setPen(agent->color());
-            if (agent->state() == Agent::Empty)
-                ++emptyAgentsCount;
-            else
-                ++fullAgentsCount;
         }
     });
 
-    ui->emptyAgentsCount->setNum(emptyAgentsCount);
-    ui->fullAgentsCount->setNum(fullAgentsCount);
+    showStats(world.stats());
 
     QColor redColor("red");
     QColor greenColor("green");
@@ -136,6 +194,7 @@ void MainWindow::drawFrame(qint64 calcTime)
         {
             QLineF line(l.first->pos(), l.second->pos());
             communicationLines.append({scene->addLine(line, l.first->state()==Agent::Empty?redPen:greenPen), 5});
+            MemoryAccounting::allocated(MemorySubsystem::SceneItems, sizeof(QGraphicsLineItem));
         }
         world.commLinesRelease();
     }
@@ -160,19 +219,61 @@ void MainWindow::drawFrame(qint64 calcTime)
         resource->avatar()->setRect(resource->boundRect());
     });
 
-    quint32 volSum = 0;
-    world.forEachWarehouse([&volSum](WorldObject* warehouse)
-    {
-        volSum += warehouse->volume();
-    });
-    ui->warehouseVolumeLabel->setNum((double)volSum);
+    updateAcousticField();
+    updateTrafficMap();
 
     if (agentsCreatedCount)
         emit readyForNewFrame();
 
-    ui->calcTimeLabel->setNum((double)calcTime);
-    ui->renderTimeLabel->setNum((double)renderTimer.elapsed());
-    ui->fpsLabel->setNum((double)++frameCount);
+    ui->memoryLabel->setText(QLocale::c().formattedDataSize(MemoryAccounting::totalBytes()) + " / "
+                             + QLocale::c().formattedDataSize(MemoryAccounting::peakTotalBytes()));
+    ui->memoryDetailsLabel->setText(MemoryAccounting::report());
+
+    ui->perfPanel->frameRendered(renderTimer.nsecsElapsed());
+}
+
+void MainWindow::updateAcousticField()
+{
+    // field is read while the world waits for the next frame, never during fast forward
+    if (!ui->showAcousticFieldCheckbox->isChecked() || fastForwarding)
+        return;
+    if (acousticFieldRefreshTimer.isValid() && acousticFieldRefreshTimer.elapsed() < ACOUSTIC_FIELD_REFRESH_MS)
+        return;
+    acousticFieldRefreshTimer.start();
+
+    AcousticChannel channel = ui->acousticFieldCombo->currentIndex() == 0 ? AcousticChannel::Resource
+                                                                          : AcousticChannel::Warehouse;
+    QSizeF size = world.worldSize();
+    if (world.communication() == CommunicationModel::Diffusion)
+        world.diffusion().render(acousticFieldImage, channel, qMax(size.width(), size.height()));
+    else
+        world.acoustics().render(acousticFieldImage, channel, qMax(size.width(), size.height()));
+    acousticFieldItem->setPixmap(QPixmap::fromImage(acousticFieldImage));
+}
+
+void MainWindow::updateTrafficMap()
+{
+    // totals are locked by the map itself, so it's fine during fast forward too
+    if (!ui->showTrafficMapCheckbox->isChecked())
+        return;
+    if (trafficMapRefreshTimer.isValid() && trafficMapRefreshTimer.elapsed() < ACOUSTIC_FIELD_REFRESH_MS)
+        return;
+    trafficMapRefreshTimer.start();
+
+    static const TrafficChannel channels[] = {TrafficChannel::All, TrafficChannel::Empty, TrafficChannel::Full};
+    world.traffic().render(trafficMapImage, channels[ui->trafficMapCombo->currentIndex()]);
+    trafficMapItem->setPixmap(QPixmap::fromImage(trafficMapImage));
+}
+
+void MainWindow::onExportTrafficMapClicked()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Export traffic map"), "traffic.bin");
+    if (fileName.isEmpty())
+        return;
+    if (!world.isTrafficRecordingOn())
+        qWarning("traffic is counted only since it was first shown, the map is empty");
+    if (!world.traffic().save(fileName))
+        qWarning("can't save traffic map to %s", qPrintable(fileName));
 }
 
 void MainWindow::removeCommunicationLines()
@@ -183,6 +284,8 @@ void MainWindow::removeCommunicationLines()
         if (--l.second <= 0)
         {
             scene->removeItem(l.first);
+            delete l.first;
+            MemoryAccounting::released(MemorySubsystem::SceneItems, sizeof(QGraphicsLineItem));
             communicationLines.removeAt(i);
         }
         else
@@ -194,6 +297,39 @@ void MainWindow::removeCommunicationLines()
     //communicationLines.clear();
 }
 
+void MainWindow::onFastForwardClicked()
+{
+    fastForwarding = true;
+    ui->fastForwardButton->setEnabled(false);
+    ui->fastForwardLabel->setText(tr("Fast forwarding..."));
+    emit fastForwardRequest(ui->fastForwardTicksSpinBox->value());
+}
+
+void MainWindow::onAdvanced(WorldSummary summary)
+{
+    fastForwarding = false;
+    ui->fastForwardButton->setEnabled(true);
+    ui->fastForwardLabel->setText(tr("%1 ticks in %2 ms, now at tick %3")
+                                  .arg(summary.ticksAdvanced)
+                                  .arg(summary.elapsedMs)
+                                  .arg(summary.tick));
+
+    showStats(world.stats());
+    trafficMapRefreshTimer.invalidate();
+    updateTrafficMap();
+}
+
+void MainWindow::showStats(const WorldStats& stats)
+{
+    ui->emptyAgentsCount->setNum(stats.emptyAgentsCount);
+    ui->fullAgentsCount->setNum(stats.fullAgentsCount);
+    ui->warehouseVolumeLabel->setNum(qRound(stats.warehouseVolume));
+    ui->bornDiedLabel->setText(QString("%1 / %2").arg(stats.births).arg(stats.deaths));
+    ui->deliveredLabel->setNum(qRound(stats.resourcesDelivered));
+    ui->meanTtlLabel->setNum(qRound(stats.meanTtl));
+    ui->workersLabel->setText(QString("%1 / %2").arg(stats.workerThreads).arg(stats.chunkSize));
+}
+
 bool MainWindow::save()
 {
     QFile file ("save.json");
@@ -7,6 +7,8 @@
 #include <QDialog>
 #include <QVector>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QImage>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -14,6 +16,7 @@ QT_END_NAMESPACE
 
 class QGraphicsView;
 class QGraphicsScene;
+class QGraphicsPixmapItem;
 class Agent;
 
 class MainWindow : public QDialog
@@ -31,24 +34,40 @@ private:
     QGraphicsView* view();
     QGraphicsScene* scene;
 
-    quint16 agentsCreatedCount = 0;
+    quint32 agentsCreatedCount = 0;
+    /// reclamation slot: queued lifecycle events and comm lines hold agent and resource pointers
+    int reclamationReader = -1;
 
     void createPoiAvatar(WorldObject& poi);
 
-    quint32 frameCount = 0;
+    bool fastForwarding = false;
+
+    QImage acousticFieldImage;
+    QGraphicsPixmapItem* acousticFieldItem = nullptr;
+    QElapsedTimer acousticFieldRefreshTimer;
+    void updateAcousticField();
+
+    QImage trafficMapImage;
+    QGraphicsPixmapItem* trafficMapItem = nullptr;
+    QElapsedTimer trafficMapRefreshTimer;
+    void updateTrafficMap();
+    void showStats(const WorldStats& stats);
 private slots:
     void onResourceAppeared(WorldObject* poi);
     void onWarehouseAppeared(WorldObject* poi);
     void onResourceDepleted(WorldObject* poi);
-    void onAgentCreated(Agent* a);
-    void onAgentDied(Agent* a);
+    void onAgentsChanged(AgentLifecycle changes);
     void drawFrame(qint64 calcTime);
     void removeCommunicationLines();
+    void onFastForwardClicked();
+    void onAdvanced(WorldSummary summary);
+    void onExportTrafficMapClicked();
 
     bool save();
 signals:
     void newResourceRequest();
     void readyForNewFrame();
+    void fastForwardRequest(quint64 ticks);
 };
 
 #endif // MAINWINDOW_H
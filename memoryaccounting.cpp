@@ -0,0 +1,116 @@
+#include "memoryaccounting.h"
+
+#include <QLocale>
+#include <QStringList>
+
+#include <atomic>
+
+static std::atomic<qint64> subsystemBytes[MEMORY_SUBSYSTEMS_COUNT];
+static std::atomic<qint64> subsystemObjects[MEMORY_SUBSYSTEMS_COUNT];
+static std::atomic<qint64> subsystemPeakBytes[MEMORY_SUBSYSTEMS_COUNT];
+static std::atomic<qint64> allBytes(0);
+static std::atomic<qint64> allPeakBytes(0);
+
+static void raisePeak(std::atomic<qint64>& peak, qint64 value)
+{
+    qint64 current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        ;
+}
+
+static void change(MemorySubsystem subsystem, qint64 bytes, qint64 objects)
+{
+    int index = static_cast<int>(subsystem);
+    qint64 now = subsystemBytes[index].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    subsystemObjects[index].fetch_add(objects, std::memory_order_relaxed);
+    raisePeak(subsystemPeakBytes[index], now);
+
+    qint64 total = allBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    raisePeak(allPeakBytes, total);
+}
+
+void MemoryAccounting::allocated(MemorySubsystem subsystem, qint64 bytes, qint64 objects)
+{
+    change(subsystem, bytes, objects);
+}
+
+void MemoryAccounting::released(MemorySubsystem subsystem, qint64 bytes, qint64 objects)
+{
+    change(subsystem, -bytes, -objects);
+}
+
+void MemoryAccounting::transfer(MemorySubsystem from, MemorySubsystem to, qint64 bytes, qint64 objects)
+{
+    change(to, bytes, objects);
+    change(from, -bytes, -objects);
+}
+
+void MemoryAccounting::set(MemorySubsystem subsystem, qint64 bytes, qint64 objects)
+{
+    int index = static_cast<int>(subsystem);
+    qint64 previousBytes = subsystemBytes[index].exchange(bytes, std::memory_order_relaxed);
+    subsystemObjects[index].store(objects, std::memory_order_relaxed);
+    raisePeak(subsystemPeakBytes[index], bytes);
+
+    qint64 total = allBytes.fetch_add(bytes - previousBytes, std::memory_order_relaxed) + bytes - previousBytes;
+    raisePeak(allPeakBytes, total);
+}
+
+MemoryUsage MemoryAccounting::usage(MemorySubsystem subsystem)
+{
+    int index = static_cast<int>(subsystem);
+    MemoryUsage u;
+    u.bytes = subsystemBytes[index].load(std::memory_order_relaxed);
+    u.objects = subsystemObjects[index].load(std::memory_order_relaxed);
+    u.peakBytes = subsystemPeakBytes[index].load(std::memory_order_relaxed);
+    return u;
+}
+
+qint64 MemoryAccounting::totalBytes()
+{
+    return allBytes.load(std::memory_order_relaxed);
+}
+
+qint64 MemoryAccounting::peakTotalBytes()
+{
+    return allPeakBytes.load(std::memory_order_relaxed);
+}
+
+QString MemoryAccounting::name(MemorySubsystem subsystem)
+{
+    switch (subsystem)
+    {
+    case MemorySubsystem::AcousticSpace:      return "Acoustic space";
+    case MemorySubsystem::Agents:             return "Agents";
+    case MemorySubsystem::DeadAgents:         return "Dead agents";
+    case MemorySubsystem::Ghosts:             return "Ghost agents";
+    case MemorySubsystem::WorldObjects:       return "Resources and warehouses";
+    case MemorySubsystem::ObjectLocks:        return "Object locks";
+    case MemorySubsystem::SceneItems:         return "Scene items";
+    case MemorySubsystem::CommunicationLines: return "Communication lines";
+    case MemorySubsystem::NeighborGrid:       return "Neighbor grid";
+    case MemorySubsystem::DiffusionField:     return "Diffusion field";
+    case MemorySubsystem::TrafficMap:         return "Traffic map";
+    }
+    return QString();
+}
+
+QString MemoryAccounting::report()
+{
+    QLocale locale = QLocale::c();
+    QStringList lines;
+    for (int i=0; i<MEMORY_SUBSYSTEMS_COUNT; i++)
+    {
+        MemorySubsystem subsystem = static_cast<MemorySubsystem>(i);
+        MemoryUsage u = usage(subsystem);
+        lines << QString("%1: %2 in %3 objects (peak %4)")
+                 .arg(name(subsystem))
+                 .arg(locale.formattedDataSize(u.bytes))
+                 .arg(u.objects)
+                 .arg(locale.formattedDataSize(u.peakBytes));
+    }
+    lines << QString("Total: %1 (peak %2)")
+             .arg(locale.formattedDataSize(totalBytes()))
+             .arg(locale.formattedDataSize(peakTotalBytes()));
+    return lines.join('\n');
+}
@@ -0,0 +1,52 @@
+#ifndef MEMORYACCOUNTING_H
+#define MEMORYACCOUNTING_H
+
+#include <QString>
+
+enum class MemorySubsystem
+{
+    AcousticSpace,
+    Agents,
+    DeadAgents,
+    Ghosts,
+    WorldObjects,
+    ObjectLocks,
+    SceneItems,
+    CommunicationLines,
+    NeighborGrid,
+    DiffusionField,
+    TrafficMap
+};
+const int MEMORY_SUBSYSTEMS_COUNT = 11;
+
+struct MemoryUsage
+{
+    qint64 bytes = 0;
+    qint64 objects = 0;
+    qint64 peakBytes = 0;
+};
+
+/** Explicit accounting of memory held by simulation subsystems.
+
+    Owners report what they allocate and release, counters are atomic and may be updated from any thread.
+    Sizes are shallow (sizeof of the objects plus known buffers), so they are a lower bound of real usage
+*/
+class MemoryAccounting
+{
+public:
+    static void allocated(MemorySubsystem subsystem, qint64 bytes, qint64 objects = 1);
+    static void released(MemorySubsystem subsystem, qint64 bytes, qint64 objects = 1);
+    static void transfer(MemorySubsystem from, MemorySubsystem to, qint64 bytes, qint64 objects = 1);
+    /// for containers that are easier to measure than to track
+    static void set(MemorySubsystem subsystem, qint64 bytes, qint64 objects);
+
+    static MemoryUsage usage(MemorySubsystem subsystem);
+    static qint64 totalBytes();
+    static qint64 peakTotalBytes();
+
+    static QString name(MemorySubsystem subsystem);
+    /// one line per subsystem
+    static QString report();
+};
+
+#endif // MEMORYACCOUNTING_H
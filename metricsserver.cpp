@@ -0,0 +1,178 @@
+#include "metricsserver.h"
+#include "world.h"
+#include "memoryaccounting.h"
+
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QTextStream>
+
+MetricsServer::MetricsServer(const World& world, QObject* parent)
+    : QObject(parent), world(world)
+{}
+
+bool MetricsServer::listen(quint16 port)
+{
+    server = new QTcpServer(this);
+    connect (server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+    if (!server->listen(QHostAddress::LocalHost, port))
+    {
+        qWarning("metrics endpoint can't listen on port %u: %s", port, qPrintable(server->errorString()));
+        return false;
+    }
+
+    rateSampler = new QTimer(this);
+    connect (rateSampler, &QTimer::timeout, this, &MetricsServer::sampleTickRate);
+    rateSampler->start(METRICS_RATE_SAMPLE_MS);
+    rateTimer.start();
+    rateTick = world.stats().tick;
+    return true;
+}
+
+void MetricsServer::sampleTickRate()
+{
+    quint64 tick = world.stats().tick;
+    qint64 elapsed = rateTimer.restart();
+    if (elapsed > 0)
+        tickRate = (tick - rateTick) * 1000.0 / elapsed;
+    rateTick = tick;
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (QTcpSocket* socket = server->nextPendingConnection())
+    {
+        connect (socket, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+        connect (socket, &QTcpSocket::disconnected, this, [this, socket]()
+        {
+            requests.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MetricsServer::onReadyRead()
+{
+    QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+    if (!socket)
+        return;
+
+    QByteArray& request = requests[socket];
+    request += socket->readAll();
+    if (request.size() > METRICS_REQUEST_LIMIT)
+    {
+        respond(socket, "413 Payload Too Large", QByteArray());
+        return;
+    }
+    if (!request.contains("\r\n\r\n"))
+        return;
+
+    QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+    if (requestLine.count() < 2 || requestLine[0] != "GET")
+        respond(socket, "405 Method Not Allowed", QByteArray());
+    else if (requestLine[1] != "/metrics" && requestLine[1] != "/")
+        respond(socket, "404 Not Found", QByteArray());
+    else
+        respond(socket, "200 OK", metrics());
+}
+
+void MetricsServer::respond(QTcpSocket* socket, const QByteArray& status, const QByteArray& body)
+{
+    requests.remove(socket);
+    disconnect (socket, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+            "Content-Type: text/plain; version=0.0.4\r\n"
+            "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+            "Connection: close\r\n\r\n" + body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
+
+QByteArray MetricsServer::metrics() const
+{
+    WorldStats stats = world.stats();
+
+    QByteArray text;
+    QTextStream out(&text);
+    auto metric = [&out](const char* name, const char* type, const char* help)
+    {
+        out << "# HELP " << name << ' ' << help << '\n'
+            << "# TYPE " << name << ' ' << type << '\n';
+    };
+
+    metric("swarm_ticks_total", "counter", "Ticks simulated");
+    out << "swarm_ticks_total " << stats.tick << '\n';
+
+    metric("swarm_tick_rate", "gauge", "Ticks per second over the last sampling period");
+    out << "swarm_tick_rate " << tickRate << '\n';
+
+    metric("swarm_tick_seconds", "gauge", "Duration of the last tick");
+    out << "swarm_tick_seconds " << stats.tickNs / 1e9 << '\n';
+
+    metric("swarm_tick_phase_seconds", "gauge", "Duration of the phases of the last tick");
+    for (int i=0; i<TICK_PHASES_COUNT; i++)
+        out << "swarm_tick_phase_seconds{phase=\"" << tickPhaseName(static_cast<TickPhase>(i)) << "\"} "
+            << stats.phaseNs[i] / 1e9 << '\n';
+
+    metric("swarm_tick_lateness_seconds", "gauge", "How late the last tick started after its deadline, paced mode only");
+    out << "swarm_tick_lateness_seconds " << qMax<qint64>(0, stats.latenessNs) / 1e9 << '\n';
+
+    metric("swarm_deadline_misses_total", "counter", "Ticks started too late in paced mode");
+    out << "swarm_deadline_misses_total " << stats.deadlineMisses << '\n';
+
+    metric("swarm_worker_threads", "gauge", "Worker threads of the tick");
+    out << "swarm_worker_threads " << stats.workerThreads << '\n';
+
+    metric("swarm_chunk_size", "gauge", "Agents per parallel task of the tick");
+    out << "swarm_chunk_size " << stats.chunkSize << '\n';
+
+    metric("swarm_agents", "gauge", "Alive agents");
+    out << "swarm_agents{state=\"empty\"} " << stats.emptyAgentsCount << '\n'
+        << "swarm_agents{state=\"full\"} " << stats.fullAgentsCount << '\n';
+
+    metric("swarm_agent_mean_ttl", "gauge", "Mean ticks left to live of alive agents");
+    out << "swarm_agent_mean_ttl " << stats.meanTtl << '\n';
+
+    metric("swarm_agent_shouts", "gauge", "Agents that shouted during the last tick");
+    out << "swarm_agent_shouts " << stats.shoutsCount << '\n';
+
+    metric("swarm_retired_objects", "gauge", "Agents and resources removed from the world and waiting to be freed");
+    out << "swarm_retired_objects " << stats.retiredCount << '\n';
+
+    metric("swarm_agent_disorder", "gauge", "Part of consecutive agents out of Morton order, with locality reordering");
+    out << "swarm_agent_disorder " << stats.agentDisorder << '\n';
+
+    metric("swarm_agent_births_total", "counter", "Agents created");
+    out << "swarm_agent_births_total " << stats.totalBirths << '\n';
+
+    metric("swarm_agent_deaths_total", "counter", "Agents died");
+    out << "swarm_agent_deaths_total " << stats.totalDeaths << '\n';
+
+    metric("swarm_resources", "gauge", "Resources in the world");
+    out << "swarm_resources " << stats.resourcesCount << '\n';
+
+    metric("swarm_warehouses", "gauge", "Warehouses in the world");
+    out << "swarm_warehouses " << stats.warehousesCount << '\n';
+
+    metric("swarm_warehouse_volume", "gauge", "Resource volume stored in all warehouses");
+    out << "swarm_warehouse_volume " << stats.warehouseVolume << '\n';
+
+    metric("swarm_resources_delivered_total", "counter", "Resource volume delivered to warehouses");
+    out << "swarm_resources_delivered_total " << stats.totalResourcesDelivered << '\n';
+
+    metric("swarm_memory_bytes", "gauge", "Memory held by simulation subsystems");
+    for (int i=0; i<MEMORY_SUBSYSTEMS_COUNT; i++)
+    {
+        MemorySubsystem subsystem = static_cast<MemorySubsystem>(i);
+        out << "swarm_memory_bytes{subsystem=\"" << MemoryAccounting::name(subsystem) << "\"} "
+            << MemoryAccounting::usage(subsystem).bytes << '\n';
+    }
+
+    metric("swarm_memory_peak_bytes", "gauge", "Peak of memory held by all simulation subsystems");
+    out << "swarm_memory_peak_bytes " << MemoryAccounting::peakTotalBytes() << '\n';
+
+    out.flush();
+    return text;
+}
@@ -0,0 +1,52 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QByteArray>
+
+const int METRICS_RATE_SAMPLE_MS = 1000;
+const int METRICS_REQUEST_LIMIT = 8192;
+
+class QTcpServer;
+class QTcpSocket;
+class QTimer;
+class World;
+
+/** Local HTTP endpoint serving world metrics in Prometheus text format.
+
+    Lives in its own thread: every scrape reads World::stats() and MemoryAccounting, both of them
+    only take a short lock or none, so the simulation never waits for a scraper
+*/
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+    const World& world;
+    QTcpServer* server = nullptr;
+    QHash<QTcpSocket*, QByteArray> requests;
+
+    QTimer* rateSampler = nullptr;
+    QElapsedTimer rateTimer;
+    quint64 rateTick = 0;
+    qreal tickRate = 0;
+
+    void respond(QTcpSocket* socket, const QByteArray& status, const QByteArray& body);
+
+public:
+    MetricsServer(const World& world, QObject* parent = nullptr);
+
+    QByteArray metrics() const;
+
+public slots:
+    /// has to be called in the thread the server lives in
+    bool listen(quint16 port);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+    void sampleTickRate();
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,72 @@
+#include "neighborgrid.h"
+#include "agent.h"
+#include "memoryaccounting.h"
+
+#include <math.h>
+
+NeighborGrid::NeighborGrid(QRectF bound, qreal cellSize)
+    :boundRect(bound), cellSize(cellSize)
+{
+    columns = qMax(1, (int)ceil(bound.width() / cellSize));
+    rows = qMax(1, (int)ceil(bound.height() / cellSize));
+    cellStart.fill(0, columns * rows + 1);
+}
+
+int NeighborGrid::columnAt(qreal x) const
+{
+    return qBound(0, (int)floor((x - boundRect.left()) / cellSize), columns - 1);
+}
+
+int NeighborGrid::rowAt(qreal y) const
+{
+    return qBound(0, (int)floor((y - boundRect.top()) / cellSize), rows - 1);
+}
+
+void NeighborGrid::rebuild(const QVector<Agent*>& agents)
+{
+    QVector<int> cellOf;
+    cellOf.reserve(agents.count());
+    cellStart.fill(0);
+
+    foreach (Agent* agent, agents)
+    {
+        if (agent->state() == Agent::Dead)
+        {
+            cellOf.append(-1);
+            continue;
+        }
+        int cell = rowAt(agent->pos().y()) * columns + columnAt(agent->pos().x());
+        cellOf.append(cell);
+        cellStart[cell + 1]++;
+    }
+    for (int i=1; i<cellStart.count(); i++)
+        cellStart[i] += cellStart[i-1];
+
+    int total = cellStart.last();
+    items.resize(total);
+    positions.resize(total);
+    QVector<int> next(cellStart);
+    for (int i=0; i<agents.count(); i++)
+    {
+        if (cellOf[i] < 0)
+            continue;
+        int slot = next[cellOf[i]]++;
+        items[slot] = agents[i];
+        positions[slot] = agents[i]->pos();
+    }
+
+    MemoryAccounting::set(MemorySubsystem::NeighborGrid,
+                          cellStart.capacity() * sizeof(int) + items.capacity() * sizeof(Agent*)
+                          + positions.capacity() * sizeof(QPointF),
+                          total);
+}
+
+QVector<Agent*> NeighborGrid::neighborsWithin(QPointF pos, qreal r) const
+{
+    QVector<Agent*> found;
+    forEachWithin(pos, r, [&found](Agent* agent, QPointF)
+    {
+        found.append(agent);
+    });
+    return found;
+}
@@ -0,0 +1,66 @@
+#ifndef NEIGHBORGRID_H
+#define NEIGHBORGRID_H
+
+#include <QRectF>
+#include <QPointF>
+#include <QVector>
+
+const qreal NEIGHBOR_GRID_CELL_SIZE = 10;
+
+class Agent;
+
+/** Cell list over agent positions, rebuilt once per tick.
+
+    Agents are bucketed into square cells with a counting sort, so a query within radius r visits only
+    the cells overlapping the query square instead of every agent. Positions are copied at rebuild time:
+    queries see the world as it was at the start of the tick and may run in parallel with agents moving
+*/
+class NeighborGrid
+{
+    QRectF boundRect;
+    qreal cellSize;
+    int columns = 0;
+    int rows = 0;
+
+    /// agents of cell i are items[cellStart[i]] .. items[cellStart[i+1]-1]
+    QVector<int> cellStart;
+    QVector<Agent*> items;
+    QVector<QPointF> positions;
+
+    int columnAt(qreal x) const;
+    int rowAt(qreal y) const;
+
+public:
+    NeighborGrid(QRectF bound, qreal cellSize = NEIGHBOR_GRID_CELL_SIZE);
+
+    /// dead agents are left out
+    void rebuild(const QVector<Agent*>& agents);
+
+    /// calls f(agent, position at rebuild time) for every agent not farther than r from pos
+    template<class F> void forEachWithin(QPointF pos, qreal r, F f) const
+    {
+        int firstColumn = columnAt(pos.x() - r);
+        int lastColumn = columnAt(pos.x() + r);
+        int firstRow = rowAt(pos.y() - r);
+        int lastRow = rowAt(pos.y() + r);
+        qreal rr = r * r;
+
+        for (int row = firstRow; row <= lastRow; row++)
+        {
+            // cells of a row are adjacent in items
+            int first = cellStart[row * columns + firstColumn];
+            int last = cellStart[row * columns + lastColumn + 1];
+            for (int i = first; i < last; i++)
+            {
+                QPointF d = positions[i] - pos;
+                if (d.x()*d.x() + d.y()*d.y() <= rr)
+                    f(items[i], positions[i]);
+            }
+        }
+    }
+    QVector<Agent*> neighborsWithin(QPointF pos, qreal r) const;
+
+    int count() const {return items.count();}
+};
+
+#endif // NEIGHBORGRID_H
@@ -0,0 +1,91 @@
+#ifndef PERFMONITOR_H
+#define PERFMONITOR_H
+
+#include <QVector>
+
+#include <atomic>
+#include <chrono>
+
+const int PERF_RING_SIZE = 4096;
+
+/// monotonic clock shared by all performance samples
+inline qint64 perfClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct TickSample
+{
+    quint64 tick = 0;
+    qint64 atNs = 0;
+    qint64 tickNs = 0;
+    int agentsCount = 0;
+    /// -1 unless the world is paced
+    qint64 latenessNs = -1;
+};
+
+struct FrameSample
+{
+    qint64 atNs = 0;
+    qint64 renderNs = 0;
+};
+
+/** Ring of the latest N samples with one writer and one reader on any threads.
+
+    The writer never waits: a reader that falls behind by more than N samples loses the oldest ones,
+    and a slot overwritten while being copied is detected by its sequence number and skipped
+*/
+template<class T, int N = PERF_RING_SIZE> class SampleRing
+{
+    static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+
+    struct Slot
+    {
+        /// index + 1 of the sample in the slot, 0 while it's being written
+        std::atomic<quint64> sequence {0};
+        T sample;
+    };
+    Slot slots[N];
+    std::atomic<quint64> written {0};
+
+public:
+    void push(const T& sample)
+    {
+        quint64 index = written.load(std::memory_order_relaxed);
+        Slot& slot = slots[index & (N - 1)];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.sample = sample;
+        slot.sequence.store(index + 1, std::memory_order_release);
+        written.store(index + 1, std::memory_order_release);
+    }
+
+    /// append samples written since position next to out and move next past them, returns how many were lost
+    int drain(quint64& next, QVector<T>& out) const
+    {
+        quint64 end = written.load(std::memory_order_acquire);
+        int lost = 0;
+        if (end - next > (quint64)N)
+        {
+            lost = end - N - next;
+            next = end - N;
+        }
+        for (; next < end; next++)
+        {
+            const Slot& slot = slots[next & (N - 1)];
+            quint64 before = slot.sequence.load(std::memory_order_acquire);
+            T sample = slot.sample;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (before != next + 1 || slot.sequence.load(std::memory_order_relaxed) != before)
+            {
+                lost++;
+                continue;
+            }
+            out.append(sample);
+        }
+        return lost;
+    }
+};
+
+#endif // PERFMONITOR_H
@@ -0,0 +1,167 @@
+#include "perfpanel.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+
+#include <algorithm>
+
+const int SPARKLINE_HEIGHT = 36;
+
+template<class T, class F> static PerfPercentiles percentiles(const QVector<T>& samples, F nsOf)
+{
+    PerfPercentiles p;
+    if (samples.isEmpty())
+        return p;
+
+    QVector<qint64> ns;
+    ns.reserve(samples.count());
+    for (const T& sample : samples)
+        ns.append(nsOf(sample));
+    std::sort(ns.begin(), ns.end());
+
+    auto at = [&ns](qreal q) { return ns[(int)((ns.count() - 1) * q)] / 1e6; };
+    p.p50 = at(0.50);
+    p.p95 = at(0.95);
+    p.p99 = at(0.99);
+    return p;
+}
+
+/// drop samples older than the window, they are in time order
+template<class T> static void trim(QVector<T>& samples, qint64 oldestNs)
+{
+    int n = 0;
+    while (n < samples.count() && samples[n].atNs < oldestNs)
+        n++;
+    samples.remove(0, n);
+}
+
+template<class T> static void appendHistory(QVector<T>& history, const T& point)
+{
+    if (history.count() == PERF_HISTORY_POINTS)
+        history.removeFirst();
+    history.append(point);
+}
+
+PerfPanel::PerfPanel(QWidget* parent)
+    : QWidget(parent)
+{
+    startNs = perfClockNs();
+    connect (&refreshTimer, &QTimer::timeout, this, &PerfPanel::refresh);
+    refreshTimer.start(PERF_REFRESH_MS);
+}
+
+void PerfPanel::watch(const SampleRing<TickSample>& ticks)
+{
+    tickRing = &ticks;
+    nextTick = 0;
+}
+
+void PerfPanel::frameRendered(qint64 renderNs)
+{
+    FrameSample sample;
+    sample.atNs = perfClockNs();
+    sample.renderNs = renderNs;
+    frameRing.push(sample);
+}
+
+QSize PerfPanel::sizeHint() const
+{
+    return QSize(220, 6 * fontMetrics().height() + 2 * SPARKLINE_HEIGHT + 8);
+}
+
+void PerfPanel::refresh()
+{
+    if (tickRing)
+        lostSamples += tickRing->drain(nextTick, ticks);
+    lostSamples += frameRing.drain(nextFrame, frames);
+
+    qint64 now = perfClockNs();
+    trim(ticks, now - PERF_WINDOW_NS);
+    trim(frames, now - PERF_WINDOW_NS);
+
+    qreal span = qMax<qint64>(1, qMin(PERF_WINDOW_NS, now - startNs)) / 1e9;
+    ticksPerSecond = 0;
+    agentUpdatesPerSecond = 0;
+    if (!ticks.isEmpty())
+    {
+        // tick numbers count ticks whose samples were lost
+        quint64 ticksCount = ticks.last().tick - ticks.first().tick + 1;
+        qint64 agentsSum = 0;
+        for (const TickSample& sample : qAsConst(ticks))
+            agentsSum += sample.agentsCount;
+        ticksPerSecond = ticksCount / span;
+        agentUpdatesPerSecond = (qreal)agentsSum / ticks.count() * ticksCount / span;
+    }
+    framesPerSecond = frames.count() / span;
+
+    tickMs = percentiles(ticks, [](const TickSample& s) { return s.tickNs; });
+    paced = !ticks.isEmpty() && ticks.last().latenessNs >= 0;
+    latenessMs = percentiles(ticks, [](const TickSample& s) { return qMax<qint64>(0, s.latenessNs); });
+    renderMs = percentiles(frames, [](const FrameSample& s) { return s.renderNs; });
+    appendHistory(tickHistory, tickMs);
+    appendHistory(renderHistory, renderMs);
+
+    update();
+}
+
+void PerfPanel::drawSparkline(QPainter& painter, const QRect& box, const QVector<PerfPercentiles>& history) const
+{
+    painter.setPen(QPen(Qt::lightGray, 0));
+    painter.setBrush(Qt::NoBrush);
+    painter.drawRect(box);
+    if (history.count() < 2)
+        return;
+
+    qreal highest = 0;
+    for (const PerfPercentiles& p : history)
+        highest = qMax(highest, p.p99);
+    if (highest <= 0)
+        return;
+
+    auto line = [&](qreal PerfPercentiles::* field, const QColor& color)
+    {
+        QPolygonF points;
+        for (int i=0; i<history.count(); i++)
+        {
+            qreal x = box.left() + (qreal)i * box.width() / (PERF_HISTORY_POINTS - 1);
+            qreal y = box.bottom() - history[i].*field / highest * box.height();
+            points.append(QPointF(x, y));
+        }
+        painter.setPen(QPen(color, 1));
+        painter.drawPolyline(points);
+    };
+    line(&PerfPercentiles::p50, QColor("green"));
+    line(&PerfPercentiles::p95, QColor("orange"));
+    line(&PerfPercentiles::p99, QColor("red"));
+
+    painter.setPen(QPen(Qt::gray, 0));
+    painter.drawText(box.adjusted(2, 0, -2, 0), Qt::AlignRight | Qt::AlignTop, QString::number(highest, 'f', 2));
+}
+
+void PerfPanel::paintEvent(QPaintEvent*)
+{
+    QPainter painter(this);
+    int lineHeight = fontMetrics().height();
+    int y = 0;
+    auto text = [&](const QString& line)
+    {
+        painter.setPen(palette().color(QPalette::WindowText));
+        painter.drawText(QRect(0, y, width(), lineHeight), Qt::AlignLeft | Qt::AlignVCenter, line);
+        y += lineHeight;
+    };
+    auto tails = [](const PerfPercentiles& p)
+    {
+        return QString("%1 / %2 / %3 ms").arg(p.p50, 0, 'f', 2).arg(p.p95, 0, 'f', 2).arg(p.p99, 0, 'f', 2);
+    };
+
+    text(tr("Ticks/s %1, frames/s %2").arg(ticksPerSecond, 0, 'f', 1).arg(framesPerSecond, 0, 'f', 1));
+    text(tr("Agent updates/s %1").arg(agentUpdatesPerSecond, 0, 'f', 0)
+         + (lostSamples ? tr(" (%1 samples lost)").arg(lostSamples) : QString()));
+    text(tr("Tick p50/p95/p99 ") + tails(tickMs));
+    if (paced)
+        text(tr("Late p50/p95/p99 ") + tails(latenessMs));
+    drawSparkline(painter, QRect(0, y, width() - 1, SPARKLINE_HEIGHT), tickHistory);
+    y += SPARKLINE_HEIGHT + 4;
+    text(tr("Render p50/p95/p99 ") + tails(renderMs));
+    drawSparkline(painter, QRect(0, y, width() - 1, SPARKLINE_HEIGHT), renderHistory);
+}
@@ -0,0 +1,72 @@
+#ifndef PERFPANEL_H
+#define PERFPANEL_H
+
+#include "perfmonitor.h"
+
+#include <QWidget>
+#include <QTimer>
+#include <QVector>
+
+const qint64 PERF_WINDOW_NS = 5000000000LL;
+const int PERF_REFRESH_MS = 250;
+const int PERF_HISTORY_POINTS = 120;
+
+/// p50, p95 and p99 of a window
+struct PerfPercentiles
+{
+    qreal p50 = 0;
+    qreal p95 = 0;
+    qreal p99 = 0;
+};
+
+/** Rolling window of tick and frame samples with rates, tail latencies and their recent history as sparklines.
+
+    Ticks come from the world's SampleRing, frames from frameRendered(); both are drained by a timer,
+    so neither the world nor drawing ever waits for the panel
+*/
+class PerfPanel : public QWidget
+{
+    Q_OBJECT
+
+    const SampleRing<TickSample>* tickRing = nullptr;
+    quint64 nextTick = 0;
+    SampleRing<FrameSample> frameRing;
+    quint64 nextFrame = 0;
+
+    QVector<TickSample> ticks;
+    QVector<FrameSample> frames;
+    qint64 startNs = 0;
+    int lostSamples = 0;
+
+    qreal ticksPerSecond = 0;
+    qreal framesPerSecond = 0;
+    qreal agentUpdatesPerSecond = 0;
+    PerfPercentiles tickMs;
+    PerfPercentiles renderMs;
+    /// only while the world is paced
+    bool paced = false;
+    PerfPercentiles latenessMs;
+    QVector<PerfPercentiles> tickHistory;
+    QVector<PerfPercentiles> renderHistory;
+
+    QTimer refreshTimer;
+
+    void drawSparkline(QPainter& painter, const QRect& box, const QVector<PerfPercentiles>& history) const;
+
+public:
+    PerfPanel(QWidget* parent = nullptr);
+
+    void watch(const SampleRing<TickSample>& ticks);
+    /// GUI thread, once per drawn frame
+    void frameRendered(qint64 renderNs);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private slots:
+    void refresh();
+};
+
+#endif // PERFPANEL_H
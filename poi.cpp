@@ -10,7 +10,16 @@
 
 WorldObject::WorldObject(QObject* parent)
     :QObject(parent), accessMutex(QReadWriteLock::Recursive)
-{}
+{
+    MemoryAccounting::allocated(MemorySubsystem::WorldObjects, sizeof(WorldObject));
+    MemoryAccounting::allocated(MemorySubsystem::ObjectLocks, sizeof(QReadWriteLock));
+}
+
+WorldObject::~WorldObject()
+{
+    MemoryAccounting::released(MemorySubsystem::WorldObjects, sizeof(WorldObject));
+    MemoryAccounting::released(MemorySubsystem::ObjectLocks, sizeof(QReadWriteLock));
+}
 
 QRectF WorldObject::boundRect() const
 {
@@ -109,6 +118,7 @@ void WorldObject::buildAvatar(QGraphicsScene *scene)
     gItem->setPos(pos());
 
     avtr.pEllipse = gItem;
+    MemoryAccounting::allocated(MemorySubsystem::SceneItems, sizeof(QGraphicsEllipseItem));
 }
 
 PointOfInterestAvatar *WorldObject::avatar() {return &avtr;}
@@ -132,7 +142,9 @@ void WorldObject::write(QJsonObject &json) const
 
 void WorldObject::read(const QJsonObject & json)
 {
-    setRadius( json["raidus"].toDouble() );
+    setRadius( json["radius"].toDouble(radius()) );
+    setVolume( json["volume"].toDouble(volume()) );
+    setCapacity( json["capacity"].toDouble(capacity()) );
 
     if (json.contains("position") && json["position"].isObject())
     {
@@ -9,6 +9,8 @@
 
 #include <QReadWriteLock>
 
+#include "memoryaccounting.h"
+
 const qreal PI = 3.1415926;
 
 
@@ -18,14 +20,14 @@ struct PointOfInterestAvatar
 
     void setBrush(QBrush b)
     {
-        pEllipse->setBrush(b);
+        if (pEllipse) pEllipse->setBrush(b);
     }
 
-    QBrush brush() const { return pEllipse->brush(); }
+    QBrush brush() const { return pEllipse ? pEllipse->brush() : QBrush(); }
 
     void setPos(QPointF p)
     {
-        pEllipse->setPos(p);
+        if (pEllipse) pEllipse->setPos(p);
     }
 
     void setAlpha(qreal a)
@@ -39,11 +41,13 @@ struct PointOfInterestAvatar
 
     void setRect(QRectF r)
     {
-        pEllipse->setRect(r);
+        if (pEllipse) pEllipse->setRect(r);
     }
 
     void setBorderWidth(int w)
     {
+        if (!pEllipse)
+            return;
         QPen pen = pEllipse->pen();
         pen.setWidth(w);
         pEllipse->setPen(pen);
@@ -51,10 +55,15 @@ struct PointOfInterestAvatar
 
     void destroy()
     {
+        if (!pEllipse)
+            return;
         QGraphicsScene* scene = pEllipse->scene();
         if (scene->thread() != QThread::currentThread())
             throw "wrong thread";
         scene->removeItem(pEllipse);
+        delete pEllipse;
+        pEllipse = nullptr;
+        MemoryAccounting::released(MemorySubsystem::SceneItems, sizeof(QGraphicsEllipseItem));
     }
 };
 
@@ -69,9 +78,11 @@ class WorldObject : public QObject
     qreal   _capacity = 0;
     QPointF _position = {0, 0};
     QColor  _color;
+    quint32 _serialNumber = 0;
 
 public:
     WorldObject(QObject* parent = nullptr);
+    ~WorldObject();
 
     virtual QRectF boundRect() const;
 
@@ -95,6 +106,7 @@ public:
     qreal capacity() const;
     QPointF pos() const;
     virtual QColor color() const;
+    quint32 serialNumber() const {return _serialNumber;}
 
     void invalidate() { valid = false; }
     WorldObject& setPos(QPointF p);
@@ -102,6 +114,7 @@ public:
     WorldObject& setVolume(qreal v);
     WorldObject& setCapacity(qreal capacity = -1);
     WorldObject& setColor(const QColor& color);
+    WorldObject& setSerialNumber(quint32 serial) {_serialNumber = serial; return *this;}
 };
 
 #endif // POI_H
@@ -0,0 +1,42 @@
+#ifndef POOLMAP_H
+#define POOLMAP_H
+
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <QFuture>
+#include <QVector>
+
+#include <atomic>
+
+/** QtConcurrent::blockingMap on a thread pool of the caller instead of the global one.
+
+    Qt 5 has no blockingMap taking a pool, there every thread of the pool runs a loop taking the next
+    item until none is left, so items are handed out one at a time as blockingMap does
+*/
+template<class Sequence, class F> void blockingMapOn(QThreadPool* pool, Sequence& sequence, F f)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    QtConcurrent::blockingMap(pool, sequence, f);
+#else
+    int count = sequence.size();
+    if (count == 0)
+        return;
+    // detach here, not in the workers
+    auto items = sequence.begin();
+    std::atomic<int> next(0);
+    auto runner = [&]()
+    {
+        for (int i = next++; i < count; i = next++)
+            f(items[i]);
+    };
+
+    int runners = qMin(count, qMax(1, pool->maxThreadCount()));
+    QVector<QFuture<void>> futures;
+    for (int r=0; r<runners; r++)
+        futures.append(QtConcurrent::run(pool, runner));
+    foreach (QFuture<void> future, futures)
+        future.waitForFinished();
+#endif
+}
+
+#endif // POOLMAP_H
@@ -0,0 +1,437 @@
+#include "referenceworld.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <math.h>
+
+ReferenceWorld::ReferenceWorld(World& world)
+    : bound(world.boundRect()), acousticBound(world.boundRect().toRect()),
+      random(world.random), agentSeeds(world.agentSeeds),
+      agentShoutRange(world.agentShoutRange), newAgentPrice(world.newAgentPrice), agentSeparation(world.agentSeparation),
+      tick(world.tick), poiSerialCounter(world.poiSerialCounter), agentSerialCounter(world.agentSerialCounter),
+      lastStats(world.stats())
+{
+    if (world.domain)
+        throw std::runtime_error("reference doesn't model a split world");
+    if (world.communicationModel != CommunicationModel::Acoustic || world.incrementalShouting)
+        throw std::runtime_error("reference models acoustic communication without incremental shouting only");
+
+    QMutexLocker lock(&world.agentListAccess);
+    foreach (const Agent* agent, world.agents)
+    {
+        ReferenceAgent a;
+        a.serial = agent->serialNumber();
+        a.pos = agent->pos();
+        a.radius = agent->radius();
+        a.capacity = agent->capacity();
+        a.volume = agent->volume();
+        a.shoutRange = agent->shoutRange;
+        a.speedDist = agent->speed.dist;
+        a.angle = agent->speed.angle;
+        a.ttl = agent->ttl;
+        a.distanceToResource = agent->distanceToResource;
+        a.distanceToWarehouse = agent->distanceToWarehouse;
+        a.random = agent->random;
+        a.reported = agent->state() == Agent::Dead && !agent->avtr.valid;
+        agents.append(a);
+    }
+
+    auto copyPoi = [](const WorldObject* poi)
+    {
+        ReferencePoi p;
+        p.serial = poi->serialNumber();
+        p.pos = poi->pos();
+        p.radius = poi->radius();
+        p.volume = poi->volume();
+        p.capacity = poi->capacity();
+        p.valid = poi->isValid();
+        return p;
+    };
+    world.forEachResource([&](const WorldObject* poi) { resources.append(copyPoi(poi)); });
+    world.forEachWarehouse([&](const WorldObject* poi) { warehouses.append(copyPoi(poi)); });
+
+    int cells = acousticBound.width() * acousticBound.height();
+    resourceDistances.resize(cells);
+    resourceSenders.resize(cells);
+    warehouseDistances.resize(cells);
+    warehouseSenders.resize(cells);
+}
+
+QPointF ReferenceWorld::randomWorldCoord(qreal margin)
+{
+    qint32 x = random.bounded((qint32)(bound.left() + margin), (qint32)(bound.right() - margin));
+    qint32 y = random.bounded((qint32)(bound.top() + margin), (qint32)(bound.bottom() - margin));
+    return QPointF(x, y);
+}
+
+void ReferenceWorld::addResource()
+{
+    ReferencePoi poi;
+    poi.radius = RESOURCE_INITIAL_RADIUS;
+    poi.pos = randomWorldCoord(RESOURCE_INITIAL_RADIUS);
+    poi.volume = PI * pow(RESOURCE_INITIAL_RADIUS, 2);
+    poi.capacity = PI * pow(RESOURCE_INITIAL_RADIUS, 2);
+    poi.serial = ++poiSerialCounter;
+    poi.createdTick = tick;
+    resources.append(poi);
+}
+
+void ReferenceWorld::addAgent(QPointF position)
+{
+    // draws in the order of Agent constructor and World::createAgent
+    ReferenceAgent agent;
+    agent.random.state = agentSeeds.generate64();
+    agent.speedDist = agent.random.bounded(1.0) + 2;
+    agent.angle = agent.random.bounded(2 * PI);
+    if (position == QPointF())
+        randomWorldCoord(DEFAULT_INITIAL_AGENT_RADIUS);
+    agent.ttl = agent.random.bounded(6000, 10000);
+
+    agent.serial = ++agentSerialCounter;
+    agent.pos = position;
+    agent.radius = DEFAULT_INITIAL_AGENT_RADIUS;
+    agent.capacity = PI * DEFAULT_INITIAL_AGENT_RADIUS * DEFAULT_INITIAL_AGENT_RADIUS;
+    agent.shoutRange = agentShoutRange;
+    agents.append(agent);
+    tickBirths++;
+}
+
+QPointF ReferenceWorld::separation(int index, QPointF at) const
+{
+    const ReferenceAgent& agent = agents[index];
+    QPointF push;
+    qreal contact = 2 * agent.radius;
+    typedef QPair<int, QPointF> Neighbour;
+    foreach (const Neighbour& other, startPositions)
+    {
+        QPointF d = other.second - at;
+        if (other.first == index || d.x()*d.x() + d.y()*d.y() > contact * contact)
+            continue;
+        d = at - other.second;
+        qreal dist = sqrt(d.x()*d.x() + d.y()*d.y());
+        if (qFuzzyIsNull(dist))
+        {
+            d = QPointF(cos(agent.angle), sin(agent.angle));
+            dist = 1;
+        }
+        push += d / dist * (contact - dist) / 2;
+    }
+    return push;
+}
+
+void ReferenceWorld::move(int index)
+{
+    ReferenceAgent& agent = agents[index];
+    if (agent.ttl <= 0 || --agent.ttl == 0)
+        return;
+
+    bool changeDirection = false;
+    qreal dx = agent.speedDist * cos(agent.angle);
+    qreal dy = agent.speedDist * sin(agent.angle);
+    if (agentSeparation)
+    {
+        QPointF push = separation(index, agent.pos + QPointF(dx, dy));
+        dx += push.x();
+        dy += push.y();
+    }
+    if (agent.pos.x() + dx + agent.radius > bound.right())
+    {
+        dx = bound.right() - (agent.pos.x() + dx + agent.radius);
+        changeDirection = true;
+    }
+    if (agent.pos.x() + dx - agent.radius < bound.left())
+    {
+        dx = bound.left() - (agent.pos.x() + dx - agent.radius);
+        changeDirection = true;
+    }
+    if (agent.pos.y() + dy + agent.radius > bound.bottom())
+    {
+        dy = bound.bottom() - (agent.pos.y() + dy + agent.radius);
+        changeDirection = true;
+    }
+    if (agent.pos.y() + dy - agent.radius < bound.top())
+    {
+        dy = bound.top() - (agent.pos.y() + dy - agent.radius);
+        changeDirection = true;
+    }
+
+    if (changeDirection)
+    {
+        agent.angle += agent.random.bounded(PI);
+        while (agent.angle < -PI)
+            agent.angle += 2 * PI;
+        while (agent.angle > PI)
+            agent.angle -= 2 * PI;
+    }
+
+    QPointF delta(dx, dy);
+    agent.pos += delta;
+    agent.distanceToResource += agent.speedDist;
+    agent.distanceToWarehouse += agent.speedDist;
+
+    int resource = resourceAt(agent.pos, agent.radius);
+    if (resource >= 0)
+    {
+        resourceHits.append(qMakePair(resource, agent.serial));
+        if (agent.state() == Agent::Empty)
+            agent.volume = grabResource(resource, agent.capacity);
+        agent.distanceToResource = 0;
+        agent.angle += PI;
+        agent.pos -= delta;
+    }
+
+    int warehouse = warehouseAt(agent.pos, agent.radius);
+    if (warehouse >= 0)
+    {
+        if (agent.state() == Agent::Full)
+            agent.volume = dropResource(warehouse, agent.volume);
+        agent.angle += PI;
+        agent.distanceToWarehouse = 0;
+        agent.pos -= delta;
+    }
+}
+
+static bool collides(const ReferencePoi& poi, QPointF point, quint16 r)
+{
+    // as WorldObject::collaide
+    return pow(point.x() - poi.pos.x(), 2) + pow(point.y() - poi.pos.y(), 2) <= pow(poi.radius + r, 2);
+}
+
+int ReferenceWorld::resourceAt(QPointF pos, quint16 r)
+{
+    // depleted resources stay in the list until the next tick
+    for (int i=0; i<resources.count(); i++)
+        if (collides(resources[i], pos, r))
+        {
+            const ReferencePoi& poi = resources[i];
+            if ((!poi.valid && poi.depletedTick == tick) || poi.createdTick == tick)
+                racedHits++;
+            return i;
+        }
+    return -1;
+}
+
+int ReferenceWorld::warehouseAt(QPointF pos, quint16 r) const
+{
+    for (int i=0; i<warehouses.count(); i++)
+        if (collides(warehouses[i], pos, r))
+            return i;
+    return -1;
+}
+
+qreal ReferenceWorld::grabResource(int index, qreal capacity)
+{
+    ReferencePoi& poi = resources[index];
+    if (!poi.valid)
+        return 0;
+
+    qreal ret = qMin(poi.volume, capacity);
+    poi.volume -= ret;
+    if (poi.volume < capacity)
+    {
+        poi.valid = false;
+        poi.depletedTick = tick;
+        // poi is invalidated by the append
+        addResource();
+    }
+    else
+        poi.radius = sqrt(poi.volume / PI);
+    return ret;
+}
+
+qreal ReferenceWorld::dropResource(int index, qreal volume)
+{
+    ReferencePoi& warehouse = warehouses[index];
+    warehouse.volume += volume;
+    tickDelivered += volume;
+    if (!fedWarehouses.contains(index))
+        fedWarehouses.append(index);
+    return 0;
+}
+
+void ReferenceWorld::collectRaces()
+{
+    racedAgents.clear();
+    racedResources.clear();
+    if (!racedHits)
+        return;
+
+    QSet<int> contested;
+    for (int i=0; i<resources.count(); i++)
+        if ((!resources[i].valid && resources[i].depletedTick == tick) || resources[i].createdTick == tick)
+        {
+            contested.insert(i);
+            racedResources.append(resources[i].pos);
+        }
+    // the agent that took the last of a resource is in the race as much as those that came too late
+    foreach (auto& hit, resourceHits)
+        if (contested.contains(hit.first))
+            racedAgents.insert(hit.second);
+}
+
+void ReferenceWorld::settleWarehouses()
+{
+    foreach (int index, fedWarehouses)
+    {
+        ReferencePoi& warehouse = warehouses[index];
+        if (warehouse.volume > WAREHOUSE_RESOURCES_TO_GENERATE_NEW_AGENTS)
+        {
+            while (warehouse.volume >= newAgentPrice)
+            {
+                warehouse.volume -= newAgentPrice;
+                pendingSpawns.append(warehouse.pos + QPointF(warehouse.radius + 3, 0));
+            }
+        }
+        warehouse.radius = sqrt(qMax(warehouse.volume, warehouse.capacity) / PI);
+    }
+    fedWarehouses.clear();
+}
+
+int ReferenceWorld::cellAt(QPointF coord) const
+{
+    // truncated as in AcousticSpace::cell
+    int x_index = coord.x() - acousticBound.left();
+    int y_index = coord.y() - acousticBound.top();
+    if (x_index < 0 || y_index < 0 || x_index >= acousticBound.width() || y_index >= acousticBound.height())
+        throw std::range_error("index out of range");
+    return y_index * acousticBound.width() + x_index;
+}
+
+void ReferenceWorld::offer(QVector<qreal>& distances, QVector<int>& senders, int cell, qreal distance, int sender) const
+{
+    int current = senders[cell];
+    if (current < 0 || distances[cell] > distance
+            || (distances[cell] == distance && agents[sender].serial < agents[current].serial))
+    {
+        distances[cell] = distance;
+        senders[cell] = sender;
+    }
+}
+
+void ReferenceWorld::shout(int index)
+{
+    const ReferenceAgent& agent = agents[index];
+    QPoint center = agent.pos.toPoint();
+    int range = (int)agent.shoutRange;
+    qreal toResource = agent.distanceToResource + agent.shoutRange;
+    qreal toWarehouse = agent.distanceToWarehouse + agent.shoutRange;
+
+    for (int y = -range; y <= range; y++)
+        for (int x = -range; x <= range; x++)
+        {
+            if (x*x + y*y > range*range)
+                continue;
+            int x_index = center.x() + x - acousticBound.left();
+            int y_index = center.y() + y - acousticBound.top();
+            if (x_index < 0 || y_index < 0 || x_index >= acousticBound.width() || y_index >= acousticBound.height())
+                continue;
+            int cell = y_index * acousticBound.width() + x_index;
+            offer(resourceDistances, resourceSenders, cell, toResource, index);
+            offer(warehouseDistances, warehouseSenders, cell, toWarehouse, index);
+        }
+}
+
+void ReferenceWorld::listen(int index)
+{
+    ReferenceAgent& agent = agents[index];
+    int cell = cellAt(agent.pos);
+
+    int sender = warehouseSenders[cell];
+    if (sender >= 0 && warehouseDistances[cell] < agent.distanceToWarehouse)
+    {
+        agent.distanceToWarehouse = static_cast<quint32>(warehouseDistances[cell]);
+        if (agent.state() == Agent::Full)
+            agent.angle = atan2(agents[sender].pos.y() - agent.pos.y(), agents[sender].pos.x() - agent.pos.x());
+    }
+
+    sender = resourceSenders[cell];
+    if (sender >= 0 && resourceDistances[cell] < agent.distanceToResource)
+    {
+        agent.distanceToResource = static_cast<quint32>(resourceDistances[cell]);
+        if (agent.state() == Agent::Empty)
+            agent.angle = atan2(agents[sender].pos.y() - agent.pos.y(), agents[sender].pos.x() - agent.pos.x());
+    }
+}
+
+void ReferenceWorld::iteration()
+{
+    racedHits = 0;
+    resourceHits.clear();
+    resources.erase(std::remove_if(resources.begin(), resources.end(),
+                                   [](const ReferencePoi& poi) { return !poi.valid; }), resources.end());
+    resourceSenders.fill(-1);
+    warehouseSenders.fill(-1);
+
+    startPositions.clear();
+    for (int i=0; i<agents.count(); i++)
+        if (agents[i].state() != Agent::Dead)
+            startPositions.append(qMakePair(i, agents[i].pos));
+
+    for (int i=0; i<agents.count(); i++)
+    {
+        ReferenceAgent& agent = agents[i];
+        if (agent.state() != Agent::Dead)
+            move(i);
+        else if (!agent.reported)
+        {
+            // found dead a tick after dying, as World reports it
+            agent.reported = true;
+            tickDeaths++;
+        }
+    }
+    agents.erase(std::remove_if(agents.begin(), agents.end(),
+                                [](const ReferenceAgent& agent) { return agent.reported; }), agents.end());
+
+    for (int i=0; i<agents.count(); i++)
+        if (agents[i].state() != Agent::Dead)
+            shout(i);
+    for (int i=0; i<agents.count(); i++)
+        if (agents[i].state() != Agent::Dead)
+            listen(i);
+    settleWarehouses();
+    collectRaces();
+
+    WorldStats s;
+    qint64 ttlSum = 0;
+    foreach (const ReferenceAgent& agent, agents)
+    {
+        switch (agent.state())
+        {
+        case Agent::Empty: s.emptyAgentsCount++; break;
+        case Agent::Full:  s.fullAgentsCount++;  break;
+        case Agent::Dead:  continue;
+        }
+        ttlSum += agent.ttl;
+    }
+    s.shoutsCount = s.agentsCount();
+    if (s.agentsCount())
+        s.meanTtl = (qreal)ttlSum / s.agentsCount();
+
+    std::sort(pendingSpawns.begin(), pendingSpawns.end(), [](QPointF a, QPointF b)
+    {
+        return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+    });
+    foreach (QPointF pos, pendingSpawns)
+        addAgent(pos);
+    pendingSpawns.clear();
+
+    tick++;
+    s.tick = tick;
+    foreach (const ReferencePoi& resource, resources)
+        if (resource.valid)
+            s.resourcesCount++;
+    s.warehousesCount = warehouses.count();
+    foreach (const ReferencePoi& warehouse, warehouses)
+        s.warehouseVolume += warehouse.volume;
+    s.births = tickBirths;
+    s.deaths = tickDeaths;
+    s.resourcesDelivered = tickDelivered;
+    s.totalBirths = lastStats.totalBirths + s.births;
+    s.totalDeaths = lastStats.totalDeaths + s.deaths;
+    s.totalResourcesDelivered = lastStats.totalResourcesDelivered + s.resourcesDelivered;
+    tickBirths = 0;
+    tickDeaths = 0;
+    tickDelivered = 0;
+    lastStats = s;
+}
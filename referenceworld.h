@@ -0,0 +1,139 @@
+#ifndef REFERENCEWORLD_H
+#define REFERENCEWORLD_H
+
+#include "world.h"
+#include "agent.h"
+
+#include <QVector>
+#include <QSet>
+#include <QRandomGenerator>
+
+/// plain copy of what an Agent keeps
+struct ReferenceAgent
+{
+    quint32 serial = 0;
+    QPointF pos;
+    qreal radius = DEFAULT_INITIAL_AGENT_RADIUS;
+    qreal capacity = 0;
+    qreal volume = 0;
+    qreal shoutRange = DEFAULT_AGENT_SHOUT_RANGE;
+    qreal speedDist = 0;
+    qreal angle = 0;
+    int ttl = 0;
+    qreal distanceToResource = 10000;
+    qreal distanceToWarehouse = 10000;
+    AgentRandom random;
+    /// death was counted, the agent leaves the list
+    bool reported = false;
+
+    Agent::State state() const
+    {
+        if (ttl <= 0)
+            return Agent::Dead;
+        return qFuzzyIsNull(volume) ? Agent::Empty : Agent::Full;
+    }
+};
+
+struct ReferencePoi
+{
+    quint32 serial = 0;
+    QPointF pos;
+    qreal radius = 0;
+    qreal volume = 0;
+    qreal capacity = 0;
+    bool valid = true;
+    /// tick a resource appeared and was depleted in, to spot agents racing for it
+    quint64 createdTick = 0;
+    quint64 depletedTick = 0;
+};
+
+/** Single threaded model of World::iteration(), the yardstick parallel ticks are checked against.
+
+    Starts from a copy of a production world and then runs on its own: agents move one by one in list order,
+    then all of them shout into a dense acoustic field and then all of them listen. No locks, tiles, regions
+    or chunks, so it stays simple enough to be obviously right.
+
+    Covers the acoustic model without incremental shouting, in a world that isn't split
+*/
+class ReferenceWorld
+{
+    QRectF bound;
+    QRect acousticBound;
+    QVector<ReferenceAgent> agents;
+    QVector<ReferencePoi> resources;
+    QVector<ReferencePoi> warehouses;
+
+    QRandomGenerator random;
+    QRandomGenerator agentSeeds;
+    qreal agentShoutRange;
+    quint32 newAgentPrice;
+    bool agentSeparation;
+    quint64 tick;
+    quint32 poiSerialCounter;
+    quint32 agentSerialCounter;
+
+    /// nearest distance heard in every acoustic cell and index of its sender, -1 for silence
+    QVector<qreal> resourceDistances;
+    QVector<int> resourceSenders;
+    QVector<qreal> warehouseDistances;
+    QVector<int> warehouseSenders;
+    /// positions of alive agents as of the start of the tick, for separation
+    QVector<QPair<int, QPointF>> startPositions;
+
+    QVector<QPointF> pendingSpawns;
+    /// warehouses fed during the tick, checked for new agents after everybody has moved
+    QVector<int> fedWarehouses;
+    int tickBirths = 0;
+    int tickDeaths = 0;
+    qreal tickDelivered = 0;
+    int racedHits = 0;
+    /// resource index and serial of every agent that hit a resource this tick
+    QVector<QPair<int, quint32>> resourceHits;
+    QSet<quint32> racedAgents;
+    QVector<QPointF> racedResources;
+    void collectRaces();
+    WorldStats lastStats;
+
+    QPointF randomWorldCoord(qreal margin);
+    void addResource();
+    void addAgent(QPointF position);
+
+    QPointF separation(int index, QPointF at) const;
+    void move(int index);
+    int resourceAt(QPointF pos, quint16 r);
+    int warehouseAt(QPointF pos, quint16 r) const;
+    qreal grabResource(int index, qreal capacity);
+    qreal dropResource(int index, qreal volume);
+    void settleWarehouses();
+
+    int cellAt(QPointF coord) const;
+    void offer(QVector<qreal>& distances, QVector<int>& senders, int cell, qreal distance, int sender) const;
+    void shout(int index);
+    void listen(int index);
+
+public:
+    /// world must be started and not ticking; throws std::runtime_error for a world the reference doesn't model
+    explicit ReferenceWorld(World& world);
+
+    void iteration();
+
+    quint64 tickCount() const {return tick;}
+    const QVector<ReferenceAgent>& agentList() const {return agents;}
+    const QVector<ReferencePoi>& resourceList() const {return resources;}
+    const QVector<ReferencePoi>& warehouseList() const {return warehouses;}
+    /// counts of the last tick, the same fields World::stats() has (timings and tuning aside)
+    WorldStats stats() const {return lastStats;}
+    /** Agents of the last tick that hit a resource depleted or created earlier in the same tick.
+
+        Who gets the last of a resource depends on the order agents move in, so the parallel tick
+        may legitimately differ from the reference after such a tick
+    */
+    int racedResourceHits() const {return racedHits;}
+    /** Agents and resources such a race may have changed: every agent that hit a resource depleted or created
+        in the last tick and positions of those resources. Anything else has to agree even after a race
+    */
+    const QSet<quint32>& racedAgentSerials() const {return racedAgents;}
+    const QVector<QPointF>& racedResourcePositions() const {return racedResources;}
+};
+
+#endif // REFERENCEWORLD_H
@@ -0,0 +1,222 @@
+#include "scenarioreader.h"
+
+#include <QJsonArray>
+
+ScenarioReader::ScenarioReader(QIODevice& device, const QString& name)
+    : device(device), name(name)
+{}
+
+void ScenarioReader::fail(const QString& what) const
+{
+    throw std::runtime_error(QString("%1:%2: %3").arg(name).arg(line).arg(what).toStdString());
+}
+
+bool ScenarioReader::fill()
+{
+    if (position < buffer.size())
+        return true;
+    buffer = device.read(SCENARIO_READ_CHUNK);
+    position = 0;
+    return !buffer.isEmpty();
+}
+
+char ScenarioReader::peek()
+{
+    return fill() ? buffer[position] : '\0';
+}
+
+char ScenarioReader::next()
+{
+    if (!fill())
+        fail("unexpected end of file");
+    char c = buffer[position++];
+    if (c == '\n')
+        line++;
+    return c;
+}
+
+void ScenarioReader::skipSpace()
+{
+    while (true)
+    {
+        char c = peek();
+        if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+            return;
+        next();
+    }
+}
+
+void ScenarioReader::expect(char c)
+{
+    if (next() != c)
+        fail(QString("'%1' expected").arg(c));
+}
+
+void ScenarioReader::expectWord(const char* word)
+{
+    for (const char* c = word; *c; c++)
+        if (next() != *c)
+            fail(QString("'%1' expected").arg(word));
+}
+
+static int hexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+QString ScenarioReader::readString()
+{
+    expect('"');
+    QByteArray utf8;
+    // \u escapes are collected as UTF-16, so surrogate pairs written as two escapes stay together
+    QString escaped;
+
+    while (true)
+    {
+        char c = next();
+        if (c != '\\' && !escaped.isEmpty())
+        {
+            utf8 += escaped.toUtf8();
+            escaped.clear();
+        }
+        if (c == '"')
+            return QString::fromUtf8(utf8);
+        if (c != '\\')
+        {
+            utf8 += c;
+            continue;
+        }
+
+        char e = next();
+        if (e != 'u' && !escaped.isEmpty())
+        {
+            utf8 += escaped.toUtf8();
+            escaped.clear();
+        }
+        switch (e)
+        {
+        case '"':  utf8 += '"';  break;
+        case '\\': utf8 += '\\'; break;
+        case '/':  utf8 += '/';  break;
+        case 'b':  utf8 += '\b'; break;
+        case 'f':  utf8 += '\f'; break;
+        case 'n':  utf8 += '\n'; break;
+        case 'r':  utf8 += '\r'; break;
+        case 't':  utf8 += '\t'; break;
+        case 'u':
+        {
+            ushort code = 0;
+            for (int i=0; i<4; i++)
+            {
+                int digit = hexDigit(next());
+                if (digit < 0)
+                    fail("bad \\u escape");
+                code = code * 16 + digit;
+            }
+            escaped += QChar(code);
+            break;
+        }
+        default:
+            fail("bad escape");
+        }
+    }
+}
+
+double ScenarioReader::readNumber()
+{
+    QByteArray token;
+    while (true)
+    {
+        char c = peek();
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E')
+            token += next();
+        else
+            break;
+    }
+
+    bool ok = false;
+    double value = token.toDouble(&ok);
+    if (!ok)
+        fail(token.isEmpty() ? QString("value expected") : QString("bad number %1").arg(QString(token)));
+    return value;
+}
+
+QJsonValue ScenarioReader::readValue()
+{
+    skipSpace();
+    switch (peek())
+    {
+    case '{':
+    {
+        QJsonObject object;
+        readObject([this, &object](const QString& key)
+        {
+            object.insert(key, readValue());
+        });
+        return object;
+    }
+    case '[':
+    {
+        QJsonArray array;
+        readArray([this, &array]()
+        {
+            array.append(readValue());
+        });
+        return array;
+    }
+    case '"':
+        return readString();
+    case 't':
+        expectWord("true");
+        return true;
+    case 'f':
+        expectWord("false");
+        return false;
+    case 'n':
+        expectWord("null");
+        return QJsonValue();
+    default:
+        return readNumber();
+    }
+}
+
+void ScenarioReader::skipValue()
+{
+    skipSpace();
+    switch (peek())
+    {
+    case '{':
+        readObject([this](const QString&) { skipValue(); });
+        break;
+    case '[':
+        readArray([this]() { skipValue(); });
+        break;
+    case '"':
+        readString();
+        break;
+    case 't':
+        expectWord("true");
+        break;
+    case 'f':
+        expectWord("false");
+        break;
+    case 'n':
+        expectWord("null");
+        break;
+    default:
+        readNumber();
+    }
+}
+
+void ScenarioReader::finish()
+{
+    skipSpace();
+    if (peek() != '\0')
+        fail("unexpected data after the scenario");
+}
@@ -0,0 +1,100 @@
+#ifndef SCENARIOREADER_H
+#define SCENARIOREADER_H
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QString>
+#include <QJsonValue>
+#include <QJsonObject>
+
+#include <stdexcept>
+
+const int SCENARIO_READ_CHUNK = 1 << 20;
+
+/** Pull parser of JSON scenario files that never holds more than one chunk of the file.
+
+    The caller walks objects and arrays with readObject()/readArray() and takes only small values
+    (one agent, one resource) as QJsonValue, so a file of millions of agents is read in constant memory.
+    Syntax errors throw std::runtime_error with file name and line
+*/
+class ScenarioReader
+{
+    QIODevice& device;
+    QString name;
+    QByteArray buffer;
+    int position = 0;
+    int line = 1;
+
+    bool fill();
+    char peek();
+    char next();
+    void skipSpace();
+    void expect(char c);
+    void expectWord(const char* word);
+
+    QString readString();
+    double readNumber();
+
+public:
+    ScenarioReader(QIODevice& device, const QString& name);
+
+    [[noreturn]] void fail(const QString& what) const;
+
+    /// calls onKey(key) for every key of an object, onKey has to read or skip the value
+    template<class F> void readObject(F onKey)
+    {
+        skipSpace();
+        expect('{');
+        skipSpace();
+        if (peek() == '}')
+        {
+            next();
+            return;
+        }
+        while (true)
+        {
+            skipSpace();
+            QString key = readString();
+            skipSpace();
+            expect(':');
+            onKey(key);
+            skipSpace();
+            char c = next();
+            if (c == '}')
+                return;
+            if (c != ',')
+                fail("',' or '}' expected");
+        }
+    }
+
+    /// calls onElement() for every element of an array, onElement has to read or skip the value
+    template<class F> void readArray(F onElement)
+    {
+        skipSpace();
+        expect('[');
+        skipSpace();
+        if (peek() == ']')
+        {
+            next();
+            return;
+        }
+        while (true)
+        {
+            onElement();
+            skipSpace();
+            char c = next();
+            if (c == ']')
+                return;
+            if (c != ',')
+                fail("',' or ']' expected");
+        }
+    }
+
+    /// value built in memory, for small ones
+    QJsonValue readValue();
+    void skipValue();
+    /// nothing but whitespace is left
+    void finish();
+};
+
+#endif // SCENARIOREADER_H
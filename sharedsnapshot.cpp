@@ -0,0 +1,163 @@
+#include "sharedsnapshot.h"
+
+#include <string.h>
+
+static qint64 slotBytes(quint32 agentCapacity, quint32 poiCapacity)
+{
+    qint64 bytes = sizeof(SnapshotSlot) + agentCapacity * sizeof(SnapshotAgent) + poiCapacity * sizeof(SnapshotPoi);
+    return (bytes + 7) & ~7;
+}
+
+static SnapshotSlot* slotAt(void* base, quint32 agentCapacity, quint32 poiCapacity, int index)
+{
+    return reinterpret_cast<SnapshotSlot*>(static_cast<char*>(base) + sizeof(SnapshotHeader)
+                                           + index * slotBytes(agentCapacity, poiCapacity));
+}
+
+static SnapshotAgent* slotAgents(SnapshotSlot* slot)
+{
+    return reinterpret_cast<SnapshotAgent*>(slot + 1);
+}
+
+static SnapshotPoi* slotPois(SnapshotSlot* slot, quint32 agentCapacity)
+{
+    return reinterpret_cast<SnapshotPoi*>(slotAgents(slot) + agentCapacity);
+}
+
+SnapshotPublisher::SnapshotPublisher(const QString& name, int agentCapacity)
+    : memory(name), agentCapacity(agentCapacity)
+{}
+
+bool SnapshotPublisher::create(const QRectF& worldRect)
+{
+    // segment left by a crashed run goes away when its last user detaches
+    if (memory.attach())
+        memory.detach();
+
+    qint64 size = sizeof(SnapshotHeader) + SNAPSHOT_SLOTS * slotBytes(agentCapacity, SNAPSHOT_POI_CAPACITY);
+    if (!memory.create(size))
+    {
+        error = memory.errorString();
+        return false;
+    }
+
+    memset(memory.data(), 0, size);
+    SnapshotHeader* header = static_cast<SnapshotHeader*>(memory.data());
+    header->agentCapacity = agentCapacity;
+    header->poiCapacity = SNAPSHOT_POI_CAPACITY;
+    header->worldLeft = worldRect.left();
+    header->worldTop = worldRect.top();
+    header->worldWidth = worldRect.width();
+    header->worldHeight = worldRect.height();
+    header->published.store(0, std::memory_order_relaxed);
+    header->version = SNAPSHOT_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SNAPSHOT_MAGIC;
+    return true;
+}
+
+bool SnapshotPublisher::due() const
+{
+    return !sinceLastWrite.isValid() || sinceLastWrite.elapsed() >= SNAPSHOT_PUBLISH_INTERVAL_MS;
+}
+
+void SnapshotPublisher::write(quint64 tick, const QVector<SnapshotAgent>& agents, const QVector<SnapshotPoi>& pois)
+{
+    if (!memory.isAttached())
+        return;
+    sinceLastWrite.start();
+
+    SnapshotHeader* header = static_cast<SnapshotHeader*>(memory.data());
+    quint64 published = header->published.load(std::memory_order_relaxed);
+    SnapshotSlot* slot = slotAt(header, agentCapacity, SNAPSHOT_POI_CAPACITY, published % SNAPSHOT_SLOTS);
+
+    quint64 sequence = slot->sequence.load(std::memory_order_relaxed);
+    slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    quint32 agentsCount = qMin(agents.count(), agentCapacity);
+    quint32 poisCount = qMin(pois.count(), SNAPSHOT_POI_CAPACITY);
+    slot->tick = tick;
+    slot->agentsCount = agentsCount;
+    slot->poisCount = poisCount;
+    slot->truncated = agentsCount < (quint32)agents.count();
+    memcpy(slotAgents(slot), agents.constData(), agentsCount * sizeof(SnapshotAgent));
+    memcpy(slotPois(slot, agentCapacity), pois.constData(), poisCount * sizeof(SnapshotPoi));
+
+    slot->sequence.store(sequence + 2, std::memory_order_release);
+    header->published.store(published + 1, std::memory_order_release);
+}
+
+SnapshotReader::SnapshotReader(const QString& name)
+    : memory(name)
+{}
+
+bool SnapshotReader::attach()
+{
+    detach();
+    if (!memory.attach(QSharedMemory::ReadOnly))
+        return false;
+
+    const SnapshotHeader* h = static_cast<const SnapshotHeader*>(memory.constData());
+    if (memory.size() < (int)sizeof(SnapshotHeader) || h->magic != SNAPSHOT_MAGIC || h->version != SNAPSHOT_VERSION
+            || memory.size() < (qint64)sizeof(SnapshotHeader) + SNAPSHOT_SLOTS * slotBytes(h->agentCapacity, h->poiCapacity))
+    {
+        memory.detach();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    header = h;
+    return true;
+}
+
+void SnapshotReader::detach()
+{
+    header = nullptr;
+    if (memory.isAttached())
+        memory.detach();
+}
+
+QRectF SnapshotReader::worldRect() const
+{
+    if (!header)
+        return QRectF();
+    return QRectF(header->worldLeft, header->worldTop, header->worldWidth, header->worldHeight);
+}
+
+quint64 SnapshotReader::publishedCount() const
+{
+    return header ? header->published.load(std::memory_order_acquire) : 0;
+}
+
+bool SnapshotReader::read(WorldSnapshot& snapshot) const
+{
+    if (!header)
+        return false;
+
+    for (int attempt=0; attempt<SNAPSHOT_READ_ATTEMPTS; attempt++)
+    {
+        quint64 published = header->published.load(std::memory_order_acquire);
+        if (!published)
+            return false;
+
+        SnapshotSlot* slot = slotAt(const_cast<SnapshotHeader*>(header), header->agentCapacity, header->poiCapacity,
+                                    (published - 1) % SNAPSHOT_SLOTS);
+        quint64 before = slot->sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        quint32 agentsCount = qMin(slot->agentsCount, header->agentCapacity);
+        quint32 poisCount = qMin(slot->poisCount, header->poiCapacity);
+        snapshot.tick = slot->tick;
+        snapshot.truncated = slot->truncated;
+        snapshot.agents.resize(agentsCount);
+        snapshot.pois.resize(poisCount);
+        memcpy(snapshot.agents.data(), slotAgents(slot), agentsCount * sizeof(SnapshotAgent));
+        memcpy(snapshot.pois.data(), slotPois(slot, header->agentCapacity), poisCount * sizeof(SnapshotPoi));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot->sequence.load(std::memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
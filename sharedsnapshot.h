@@ -0,0 +1,118 @@
+#ifndef SHAREDSNAPSHOT_H
+#define SHAREDSNAPSHOT_H
+
+#include <QSharedMemory>
+#include <QElapsedTimer>
+#include <QRectF>
+#include <QVector>
+#include <QString>
+
+#include <atomic>
+
+const quint32 SNAPSHOT_MAGIC = 0x53574d53;
+const quint32 SNAPSHOT_VERSION = 1;
+const int SNAPSHOT_SLOTS = 3;
+const int SNAPSHOT_DEFAULT_AGENT_CAPACITY = 200000;
+const int SNAPSHOT_POI_CAPACITY = 256;
+const qint64 SNAPSHOT_PUBLISH_INTERVAL_MS = 16;
+const int SNAPSHOT_READ_ATTEMPTS = 4;
+
+struct SnapshotAgent
+{
+    float x;
+    float y;
+    float heading;
+    quint32 state;
+};
+
+struct SnapshotPoi
+{
+    float x;
+    float y;
+    float radius;
+    float volume;
+    float capacity;
+    quint32 warehouse;
+};
+
+/// start of the shared segment
+struct SnapshotHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 agentCapacity;
+    quint32 poiCapacity;
+    float worldLeft;
+    float worldTop;
+    float worldWidth;
+    float worldHeight;
+    /// snapshots published so far, the latest one is in slot (published - 1) % SNAPSHOT_SLOTS
+    std::atomic<quint64> published;
+};
+
+/// every slot starts with this and is followed by agentCapacity agents and poiCapacity POIs
+struct SnapshotSlot
+{
+    /// seqlock: odd while the slot is being written
+    std::atomic<quint64> sequence;
+    quint64 tick;
+    quint32 agentsCount;
+    quint32 poisCount;
+    /// world had more agents than agentCapacity
+    quint32 truncated;
+    quint32 reserved;
+};
+
+struct WorldSnapshot
+{
+    quint64 tick = 0;
+    bool truncated = false;
+    QVector<SnapshotAgent> agents;
+    QVector<SnapshotPoi> pois;
+};
+
+/** Writer of world snapshots into a shared memory ring of SNAPSHOT_SLOTS slots.
+
+    Readers in other processes never lock anything: every slot is guarded by a seqlock and the writer
+    never waits for them, so a reader can be attached, detached or killed at any time
+*/
+class SnapshotPublisher
+{
+    QSharedMemory memory;
+    int agentCapacity;
+    QElapsedTimer sinceLastWrite;
+    QString error;
+
+public:
+    SnapshotPublisher(const QString& name, int agentCapacity = SNAPSHOT_DEFAULT_AGENT_CAPACITY);
+
+    bool create(const QRectF& worldRect);
+    QString errorString() const {return error;}
+
+    /// false if a snapshot was written less than SNAPSHOT_PUBLISH_INTERVAL_MS ago
+    bool due() const;
+    void write(quint64 tick, const QVector<SnapshotAgent>& agents, const QVector<SnapshotPoi>& pois);
+};
+
+/// reader side of SnapshotPublisher
+class SnapshotReader
+{
+    QSharedMemory memory;
+    const SnapshotHeader* header = nullptr;
+
+public:
+    SnapshotReader(const QString& name);
+
+    bool attach();
+    void detach();
+    bool isAttached() const {return header;}
+
+    QRectF worldRect() const;
+    /// number of snapshots written so far, changes as long as the writer is alive
+    quint64 publishedCount() const;
+
+    /// copy of the latest consistent snapshot, false if there is none yet or the writer kept overwriting it
+    bool read(WorldSnapshot& snapshot) const;
+};
+
+#endif // SHAREDSNAPSHOT_H
@@ -0,0 +1,42 @@
+#include "snapshotpainter.h"
+
+#include <math.h>
+
+void fitWorld(QPainter& painter, const QRectF& worldRect, const QSizeF& area, qreal margin)
+{
+    qreal scale = qMin((area.width() - 2 * margin) / worldRect.width(), (area.height() - 2 * margin) / worldRect.height());
+    painter.translate(area.width() / 2.0, area.height() / 2.0);
+    painter.scale(scale, scale);
+    painter.translate(-worldRect.center());
+}
+
+void paintSnapshot(QPainter& painter, const QRectF& worldRect, const WorldSnapshot& snapshot)
+{
+    painter.setPen(QPen(Qt::black, 0));
+    painter.drawRect(worldRect);
+
+    foreach (const SnapshotPoi& poi, snapshot.pois)
+    {
+        QColor fill = poi.warehouse ? WAREHOUSE_COLOR : RESOURCE_COLOR;
+        if (poi.warehouse && poi.capacity > 0)
+            fill.setAlpha(qBound(0, (int)(poi.volume / poi.capacity * 255), 255));
+        painter.setPen(QPen(poi.warehouse ? WAREHOUSE_COLOR : RESOURCE_COLOR, 0));
+        painter.setBrush(fill);
+        painter.drawEllipse(QPointF(poi.x, poi.y), poi.radius, poi.radius);
+    }
+
+    // one draw call per color: a snapshot may hold hundreds of thousands of agents
+    QVector<QLineF> empty;
+    QVector<QLineF> full;
+    foreach (const SnapshotAgent& agent, snapshot.agents)
+    {
+        QLineF line(agent.x, agent.y,
+                    agent.x + SNAPSHOT_AGENT_HEAD * cos(agent.heading), agent.y + SNAPSHOT_AGENT_HEAD * sin(agent.heading));
+        // Agent::Empty is 0
+        (agent.state == 0 ? empty : full).append(line);
+    }
+    painter.setPen(QPen(EMPTY_AGENT_COLOR, 2));
+    painter.drawLines(empty);
+    painter.setPen(QPen(FULL_AGENT_COLOR, 2));
+    painter.drawLines(full);
+}
@@ -0,0 +1,22 @@
+#ifndef SNAPSHOTPAINTER_H
+#define SNAPSHOTPAINTER_H
+
+#include "sharedsnapshot.h"
+
+#include <QPainter>
+#include <QColor>
+
+/// same colors as Agent and World use for avatars
+const QColor EMPTY_AGENT_COLOR("red");
+const QColor FULL_AGENT_COLOR("green");
+const QColor RESOURCE_COLOR("blue");
+const QColor WAREHOUSE_COLOR("orange");
+const float SNAPSHOT_AGENT_HEAD = 6;
+
+/// transform painter so that worldRect fits centered into area, margin px kept on every side
+void fitWorld(QPainter& painter, const QRectF& worldRect, const QSizeF& area, qreal margin);
+
+/// world border, POIs and agents of a snapshot in world coordinates, thread safe as long as painters differ
+void paintSnapshot(QPainter& painter, const QRectF& worldRect, const WorldSnapshot& snapshot);
+
+#endif // SNAPSHOTPAINTER_H
@@ -0,0 +1,67 @@
+#include "tickpacer.h"
+#include "perfmonitor.h"
+
+#include <QtMath>
+
+#include <algorithm>
+#include <thread>
+
+void TickPacer::setRate(qreal ticksPerSecond)
+{
+    periodNs = ticksPerSecond > 0 ? qMax<qint64>(1, qRound64(1e9 / ticksPerSecond)) : 0;
+    deadlineNs = 0;
+    releasedCount = 0;
+    missedCount = 0;
+    resyncCount = 0;
+    std::fill(histogram, histogram + PACER_HISTOGRAM_BUCKETS, 0);
+}
+
+qint64 TickPacer::waitNextDeadline()
+{
+    qint64 now = perfClockNs();
+    if (!deadlineNs)
+        deadlineNs = now;
+
+    qint64 sleepUntilNs = deadlineNs - GRANULARITY_US * 1000LL;
+    if (now < sleepUntilNs)
+    {
+        std::chrono::nanoseconds until(sleepUntilNs);
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+                                          std::chrono::duration_cast<std::chrono::steady_clock::duration>(until)));
+    }
+    while ((now = perfClockNs()) < deadlineNs)
+        ;
+
+    qint64 latenessNs = now - deadlineNs;
+    releasedCount++;
+    if (latenessNs > periodNs * PACER_MISS_TOLERANCE)
+        missedCount++;
+
+    int bucket = 0;
+    for (qint64 us = latenessNs / 1000; us > 0 && bucket < PACER_HISTOGRAM_BUCKETS - 1; us >>= 1)
+        bucket++;
+    histogram[bucket]++;
+
+    deadlineNs += periodNs;
+    if (now - deadlineNs > PACER_MAX_LAG_PERIODS * periodNs)
+    {
+        deadlineNs = now + periodNs;
+        resyncCount++;
+    }
+    return latenessNs;
+}
+
+qint64 TickPacer::latenessPercentileNs(qreal q) const
+{
+    if (!releasedCount)
+        return 0;
+    quint64 wanted = qMax<quint64>(1, qCeil(releasedCount * q));
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < PACER_HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram[bucket];
+        if (seen >= wanted)
+            return (1LL << bucket) * 1000;
+    }
+    return (1LL << (PACER_HISTOGRAM_BUCKETS - 1)) * 1000;
+}
@@ -0,0 +1,47 @@
+#ifndef TICKPACER_H
+#define TICKPACER_H
+
+#include <QtGlobal>
+
+/// OS sleeps may wake up this late, the last GRANULARITY_US before a deadline are spun instead
+const quint16 GRANULARITY_US = 1000;
+/// a tick starting later than this part of its period has missed the deadline
+const qreal PACER_MISS_TOLERANCE = 0.1;
+/// lagging more periods than this the schedule restarts from now instead of running ticks back to back
+const int PACER_MAX_LAG_PERIODS = 2;
+/// lateness histogram: bucket 0 is under 1 us, bucket k is [2^(k-1), 2^k) us
+const int PACER_HISTOGRAM_BUCKETS = 24;
+
+/** Releases ticks at a fixed rate on absolute deadlines.
+
+    Deadlines are period apart from the first tick, so the time a tick takes doesn't shift the ones after it.
+    Every release records its lateness: time past the deadline the tick actually starts at
+*/
+class TickPacer
+{
+    qint64 periodNs = 0;
+    qint64 deadlineNs = 0;
+
+    quint64 releasedCount = 0;
+    quint64 missedCount = 0;
+    quint64 resyncCount = 0;
+    quint64 histogram[PACER_HISTOGRAM_BUCKETS] = {};
+
+public:
+    /// ticks per second, 0 runs free; restarts the schedule and statistics
+    void setRate(qreal ticksPerSecond);
+    qreal rate() const {return periodNs ? 1e9 / periodNs : 0;}
+    bool isPaced() const {return periodNs > 0;}
+
+    /// sleep until the next deadline and return how late it is released, in ns
+    qint64 waitNextDeadline();
+
+    quint64 released() const {return releasedCount;}
+    quint64 missed() const {return missedCount;}
+    /// times the schedule was given up after lagging more than PACER_MAX_LAG_PERIODS
+    quint64 resyncs() const {return resyncCount;}
+    /// upper bound of the histogram bucket holding quantile q of lateness
+    qint64 latenessPercentileNs(qreal q) const;
+};
+
+#endif // TICKPACER_H
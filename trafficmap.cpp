@@ -0,0 +1,177 @@
+#include "trafficmap.h"
+#include "acousticspace.h"
+#include "memoryaccounting.h"
+
+#include <QFile>
+#include <QDataStream>
+
+#include <atomic>
+#include <math.h>
+
+namespace
+{
+/// histogram a thread counts into and the merge epoch it was taken in
+struct ThreadHistogram
+{
+    quint64 epoch = 0;
+    TrafficHistogram* histogram = nullptr;
+};
+thread_local ThreadHistogram threadHistogramCache;
+
+/// epochs are unique across maps, a thread working for two worlds never mixes up their histograms
+std::atomic<quint64> lastEpoch(0);
+}
+
+TrafficMap::TrafficMap(QRect bound, qreal cellSize)
+    :boundRect(bound), cellSize(cellSize), epoch(++lastEpoch)
+{
+    columns = qMax(1, (int)ceil(bound.width() / cellSize));
+    rows = qMax(1, (int)ceil(bound.height() / cellSize));
+    totals[0].fill(0, columns * rows);
+    totals[1].fill(0, columns * rows);
+    MemoryAccounting::allocated(MemorySubsystem::TrafficMap, sizeof(TrafficMap) + 2 * (qint64)columns * rows * sizeof(quint64));
+}
+
+TrafficMap::~TrafficMap()
+{
+    MemoryAccounting::released(MemorySubsystem::TrafficMap, histograms.count() * histogramBytes(), histograms.count());
+    MemoryAccounting::released(MemorySubsystem::TrafficMap, sizeof(TrafficMap) + 2 * (qint64)columns * rows * sizeof(quint64));
+    qDeleteAll(histograms);
+}
+
+qint64 TrafficMap::histogramBytes() const
+{
+    return sizeof(TrafficHistogram) + 2 * (qint64)columns * rows * sizeof(quint32);
+}
+
+int TrafficMap::cellIndex(QPointF pos) const
+{
+    int column = qBound(0, (int)floor((pos.x() - boundRect.left()) / cellSize), columns - 1);
+    int row = qBound(0, (int)floor((pos.y() - boundRect.top()) / cellSize), rows - 1);
+    return row * columns + column;
+}
+
+TrafficHistogram* TrafficMap::threadHistogram()
+{
+    ThreadHistogram& cached = threadHistogramCache;
+    if (cached.epoch == epoch)
+        return cached.histogram;
+
+    // first count of this thread since the last merge
+    QMutexLocker lock(&histogramsAccess);
+    if (histogramsInUse == histograms.count())
+    {
+        TrafficHistogram* histogram = new TrafficHistogram;
+        histogram->counts[0].fill(0, columns * rows);
+        histogram->counts[1].fill(0, columns * rows);
+        histograms.append(histogram);
+        MemoryAccounting::allocated(MemorySubsystem::TrafficMap, histogramBytes());
+    }
+    cached.epoch = epoch;
+    cached.histogram = histograms[histogramsInUse++];
+    return cached.histogram;
+}
+
+void TrafficMap::count(QPointF pos, TrafficChannel channel)
+{
+    TrafficHistogram* histogram = threadHistogram();
+    int i = cellIndex(pos);
+    int c = (int)channel;
+    if (histogram->counts[c][i]++ == 0)
+        histogram->touched[c].append(i);
+}
+
+void TrafficMap::merge()
+{
+    QMutexLocker lock(&totalsAccess);
+    for (int h=0; h<histogramsInUse; h++)
+    {
+        TrafficHistogram* histogram = histograms[h];
+        for (int c=0; c<2; c++)
+        {
+            quint64* total = totals[c].data();
+            quint32* counts = histogram->counts[c].data();
+            foreach (int i, histogram->touched[c])
+            {
+                total[i] += counts[i];
+                counts[i] = 0;
+            }
+            histogram->touched[c].clear();
+        }
+    }
+    histogramsInUse = 0;
+    epoch = ++lastEpoch;
+    ticks++;
+}
+
+void TrafficMap::clear()
+{
+    QMutexLocker lock(&totalsAccess);
+    totals[0].fill(0);
+    totals[1].fill(0);
+    ticks = 0;
+}
+
+quint64 TrafficMap::sampledTicks() const
+{
+    QMutexLocker lock(&totalsAccess);
+    return ticks;
+}
+
+QVector<quint64> TrafficMap::counts(TrafficChannel channel) const
+{
+    QMutexLocker lock(&totalsAccess);
+    if (channel != TrafficChannel::All)
+        return totals[(int)channel];
+
+    QVector<quint64> sum = totals[0];
+    for (int i=0; i<sum.count(); i++)
+        sum[i] += totals[1][i];
+    return sum;
+}
+
+bool TrafficMap::save(const QString& fileName) const
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+    QMutexLocker lock(&totalsAccess);
+    out << TRAFFIC_FILE_MAGIC << TRAFFIC_FILE_VERSION << (quint32)columns << (quint32)rows << (double)cellSize
+        << (qint32)boundRect.left() << (qint32)boundRect.top() << ticks;
+    for (int c=0; c<2; c++)
+        foreach (quint64 count, totals[c])
+            out << count;
+    return out.status() == QDataStream::Ok && file.flush();
+}
+
+void TrafficMap::render(QImage& image, TrafficChannel channel) const
+{
+    static const QVector<QRgb> palette = heatPalette();
+
+    if (image.size() != boundRect.size() || image.format() != QImage::Format_ARGB32)
+        image = QImage(boundRect.size(), QImage::Format_ARGB32);
+
+    QVector<quint64> cells = counts(channel);
+    quint64 busiest = 0;
+    foreach (quint64 count, cells)
+        busiest = qMax(busiest, count);
+    qreal scale = busiest ? 255 / log1p((qreal)busiest) : 0;
+
+    // palette starts hot
+    QVector<QRgb> colors(cells.count());
+    for (int i=0; i<cells.count(); i++)
+        colors[i] = cells[i] ? palette[255 - qBound(0, (int)(log1p((qreal)cells[i]) * scale), 255)] : 0;
+
+    for (int y=0; y<boundRect.height(); y++)
+    {
+        QRgb* line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        const QRgb* cellRow = colors.constData() + qMin(rows - 1, (int)(y / cellSize)) * columns;
+        for (int x=0; x<boundRect.width(); x++)
+            line[x] = cellRow[qMin(columns - 1, (int)(x / cellSize))];
+    }
+}
@@ -0,0 +1,88 @@
+#ifndef TRAFFICMAP_H
+#define TRAFFICMAP_H
+
+#include <QRect>
+#include <QPointF>
+#include <QVector>
+#include <QMutex>
+#include <QImage>
+#include <QString>
+
+const qreal TRAFFIC_CELL_SIZE = 8;
+/// "SWTM" at the start of an exported map
+const quint32 TRAFFIC_FILE_MAGIC = 0x4d545753;
+const quint32 TRAFFIC_FILE_VERSION = 1;
+
+/// agents counted, All is the sum of both and is only read
+enum class TrafficChannel {Empty, Full, All};
+
+/// counts made by one thread since the last merge
+struct TrafficHistogram
+{
+    QVector<quint32> counts[2];
+    /// cells counted into, so merging costs as much as counting did and not a pass over the grid
+    QVector<int> touched[2];
+};
+
+/** How often agents were seen in every cell of the world, separately for empty and full ones.
+
+    Counts are agent-ticks: an agent is counted every tick in the cell it stands in, so slow or crowded
+    places score high. Workers count into histograms of their own threads with no atomics or locks on the way,
+    merge() adds them to the totals once the tick is done
+*/
+class TrafficMap
+{
+    QRect boundRect;
+    qreal cellSize;
+    int columns = 0;
+    int rows = 0;
+
+    mutable QMutex totalsAccess;
+    QVector<quint64> totals[2];
+    quint64 ticks = 0;
+
+    QMutex histogramsAccess;
+    QVector<TrafficHistogram*> histograms;
+    int histogramsInUse = 0;
+    /// changes with every merge, so threads know the histogram they hold has been merged
+    quint64 epoch = 0;
+
+    int cellIndex(QPointF pos) const;
+    TrafficHistogram* threadHistogram();
+    qint64 histogramBytes() const;
+
+public:
+    TrafficMap(QRect bound, qreal cellSize = TRAFFIC_CELL_SIZE);
+    ~TrafficMap();
+
+    TrafficMap(const TrafficMap&) = delete;
+    TrafficMap& operator=(const TrafficMap&) = delete;
+
+    /// channel is Empty or Full, may be called from many threads at once, but not together with merge()
+    void count(QPointF pos, TrafficChannel channel);
+    /// add what was counted during a tick to the totals
+    void merge();
+    /// forget all counts
+    void clear();
+
+    int columnsCount() const {return columns;}
+    int rowsCount() const {return rows;}
+    qreal cell() const {return cellSize;}
+    /// ticks merged since the last clear
+    quint64 sampledTicks() const;
+    /// counts of a channel row by row, safe to call from any thread
+    QVector<quint64> counts(TrafficChannel channel) const;
+
+    /** Write the totals as a binary array, false if the file can't be written.
+
+        Little endian: magic, version, columns, rows (quint32), cell size (double), left and top of the
+        world (qint32), sampled ticks (quint64), then columns x rows quint64 counts of empty agents row by row
+        and the same of full agents
+    */
+    bool save(const QString& fileName) const;
+
+    /// same as AcousticSpace::render with busier cells hotter on a log scale, cells nobody visited are transparent
+    void render(QImage& image, TrafficChannel channel) const;
+};
+
+#endif // TRAFFICMAP_H
@@ -0,0 +1,20 @@
+#include "viewerwindow.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Shows a running swarm simulation started with --share <name>");
+    parser.addHelpOption();
+    parser.addPositionalArgument("name", "Shared snapshot name", "[name]");
+    parser.process(a);
+
+    QString name = parser.positionalArguments().value(0, "swarm");
+    ViewerWindow w(name);
+    w.show();
+    return a.exec();
+}
@@ -0,0 +1,63 @@
+#include "viewerwindow.h"
+#include "snapshotpainter.h"
+
+#include <QPainter>
+#include <QPaintEvent>
+
+ViewerWindow::ViewerWindow(const QString& name, QWidget* parent)
+    : QWidget(parent), name(name), reader(name)
+{
+    resize(830, 830);
+    setAutoFillBackground(true);
+    setPalette(QPalette(Qt::white));
+
+    connect (&refreshTimer, &QTimer::timeout, this, &ViewerWindow::refresh);
+    refreshTimer.start(VIEWER_REFRESH_MS);
+    refresh();
+}
+
+void ViewerWindow::refresh()
+{
+    if (reader.isAttached() && sinceLastChange.isValid() && sinceLastChange.elapsed() > VIEWER_STALE_MS)
+    {
+        // simulation is gone or restarted with a new segment
+        reader.detach();
+    }
+
+    if (!reader.isAttached())
+    {
+        if (sinceAttachAttempt.isValid() && sinceAttachAttempt.elapsed() < VIEWER_REATTACH_MS)
+            return;
+        sinceAttachAttempt.start();
+        if (!reader.attach())
+        {
+            setWindowTitle(tr("Waiting for %1").arg(name));
+            return;
+        }
+        worldRect = reader.worldRect();
+        lastPublished = 0;
+        sinceLastChange.start();
+    }
+
+    quint64 published = reader.publishedCount();
+    if (published == lastPublished)
+        return;
+    if (!reader.read(snapshot))
+        return;
+    lastPublished = published;
+    sinceLastChange.start();
+
+    setWindowTitle(tr("%1: tick %2, %3 agents%4").arg(name).arg(snapshot.tick).arg(snapshot.agents.count())
+                   .arg(snapshot.truncated ? tr(" (truncated)") : QString()));
+    update();
+}
+
+void ViewerWindow::paintEvent(QPaintEvent*)
+{
+    if (worldRect.isEmpty())
+        return;
+
+    QPainter painter(this);
+    fitWorld(painter, worldRect, size(), 5);
+    paintSnapshot(painter, worldRect, snapshot);
+}
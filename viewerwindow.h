@@ -0,0 +1,43 @@
+#ifndef VIEWERWINDOW_H
+#define VIEWERWINDOW_H
+
+#include "sharedsnapshot.h"
+
+#include <QWidget>
+#include <QTimer>
+#include <QElapsedTimer>
+
+const int VIEWER_REFRESH_MS = 33;
+const int VIEWER_REATTACH_MS = 1000;
+const qint64 VIEWER_STALE_MS = 3000;
+
+/** Window of swarm-viewer: paints the latest snapshot a simulation shares in memory.
+
+    Looks like the simulation's MainWindow, but owns no World and never touches the simulation process:
+    it only polls the shared segment and attaches again when the simulation restarts
+*/
+class ViewerWindow : public QWidget
+{
+    Q_OBJECT
+
+    QString name;
+    SnapshotReader reader;
+    WorldSnapshot snapshot;
+    QRectF worldRect;
+
+    QTimer refreshTimer;
+    QElapsedTimer sinceAttachAttempt;
+    QElapsedTimer sinceLastChange;
+    quint64 lastPublished = 0;
+
+public:
+    ViewerWindow(const QString& name, QWidget* parent = nullptr);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private slots:
+    void refresh();
+};
+
+#endif // VIEWERWINDOW_H
@@ -1,20 +1,66 @@
 #include "world.h"
 #include "agent.h"
+#include "scenarioreader.h"
 #include <QMutex>
 #include <QElapsedTimer>
 #include <QRandomGenerator>
 #include <QtConcurrent>
 #include <QJsonArray>
+#include <QFile>
+#include <QThreadPool>
+#include <QMetaMethod>
+
+#include <algorithm>
+#include <numeric>
+
+const char* tickPhaseName(TickPhase phase)
+{
+    switch (phase)
+    {
+    case TickPhase::Prepare:  return "prepare";
+    case TickPhase::Move:     return "move";
+    case TickPhase::Shout:    return "shout";
+    case TickPhase::Listen:   return "listen";
+    case TickPhase::Exchange: return "exchange";
+    }
+    return "";
+}
+
+static void tallyAgent(AgentTally& tally, const Agent* agent)
+{
+    switch (agent->state())
+    {
+    case Agent::Empty: tally.emptyAgentsCount++; break;
+    case Agent::Full:  tally.fullAgentsCount++;  break;
+    case Agent::Dead:  return;
+    }
+    tally.ttlSum += agent->timeToLive();
+    if (agent->shoutsThisTick())
+        tally.shoutsCount++;
+}
+
+static void addTally(AgentTally& total, const AgentTally& part)
+{
+    total.emptyAgentsCount += part.emptyAgentsCount;
+    total.fullAgentsCount += part.fullAgentsCount;
+    total.ttlSum += part.ttlSum;
+    total.shoutsCount += part.shoutsCount;
+}
 
 Agent* World::generateNewAgent(QPointF position)
 {
-    Agent* agent = new Agent(this);
-    agent-> setRadius(DEFAULT_INITIAL_AGENT_RADIUS)
-           .setCapacity(PI * DEFAULT_INITIAL_AGENT_RADIUS * DEFAULT_INITIAL_AGENT_RADIUS);
-    agent->setPos(position);
-    connect (agent, &Agent::newCommunication, this, &World::onNewCommunication);
+    if (domain && !domain->owns(position))
+    {
+        domain->forwardSpawn(position);
+        return nullptr;
+    }
+
+    Agent* agent = createAgent(position);
 
-    emit agentCreated(agent);
+    lifecycleAccess.lock();
+    pendingLifecycle.created.append(agent);
+    tickBirths++;
+    lifecycleAccess.unlock();
 
     QMutexLocker lock(&agentListAccess);
 /*
@@ -23,41 +69,174 @@ Agent* World::generateNewAgent(QPointF position)
         agents.append(QVector<Agent*>());
 */
     agents.append(agent);
+    regions[regionIndexAt(position)].agents.append(agent);
 
     return agent;
 }
 
-void World::onStart()
+Agent* World::createAgent(QPointF position)
 {
-    stopRequested = false;
-    for (int i=0;i<3;i++)
-        onNewWarehouseRequest();
+    Agent* agent = new Agent(this, position);
+    // serials break acoustic ties and match agents of a reference run
+    agent->setSerialNumber(++agentSerialCounter);
+    agent-> setRadius(DEFAULT_INITIAL_AGENT_RADIUS)
+           .setCapacity(PI * DEFAULT_INITIAL_AGENT_RADIUS * DEFAULT_INITIAL_AGENT_RADIUS);
+    agent->setShoutingRange(agentShoutRange);
+    agent->setPos(position);
+    // communication lines are guarded by their own lock, no need to queue them to the world thread
+    connect (agent, &Agent::newCommunication, this, &World::onNewCommunication, Qt::DirectConnection);
+    return agent;
+}
 
-    for (int i=0;i <5; i++)
-        onNewResourceRequest();
+QVector<Agent*> World::spawnAgents(int count, quint16 margin)
+{
+    QRect bound = boundRect().toRect();
+    int columns = (bound.width() + SPAWN_MASK_CELL - 1) / SPAWN_MASK_CELL;
+    int rows = (bound.height() + SPAWN_MASK_CELL - 1) / SPAWN_MASK_CELL;
 
-    for (int i =0; i<AGENTS_COUNT; i++)
+    // occupancy mask: cells fully covered by a POI are never tried, only cells on POI borders need exact check
+    enum : quint8 {FreeCell = 0, BorderCell = 1, BlockedCell = 2};
+    QVector<quint8> mask(columns * rows, FreeCell);
+    QVector<WorldObject*> pois = pResources.toVector() + pWarehouse.toVector();
+    foreach (WorldObject* poi, pois)
     {
-        bool ok = true;
-        QPointF pos;
-        do
+        qreal reach = poi->radius() + margin;
+        QPointF center = poi->pos();
+        int firstColumn = qMax(0, (int)floor((center.x() - reach - bound.left()) / SPAWN_MASK_CELL));
+        int lastColumn = qMin(columns - 1, (int)floor((center.x() + reach - bound.left()) / SPAWN_MASK_CELL));
+        int firstRow = qMax(0, (int)floor((center.y() - reach - bound.top()) / SPAWN_MASK_CELL));
+        int lastRow = qMin(rows - 1, (int)floor((center.y() + reach - bound.top()) / SPAWN_MASK_CELL));
+        for (int row = firstRow; row <= lastRow; row++)
+            for (int column = firstColumn; column <= lastColumn; column++)
+            {
+                qreal left = bound.left() + column * SPAWN_MASK_CELL;
+                qreal top = bound.top() + row * SPAWN_MASK_CELL;
+                qreal right = left + SPAWN_MASK_CELL;
+                qreal bottom = top + SPAWN_MASK_CELL;
+
+                qreal nearX = qMax(qMax(left - center.x(), center.x() - right), 0.0);
+                qreal nearY = qMax(qMax(top - center.y(), center.y() - bottom), 0.0);
+                qreal farX = qMax(qAbs(center.x() - left), qAbs(center.x() - right));
+                qreal farY = qMax(qAbs(center.y() - top), qAbs(center.y() - bottom));
+
+                quint8& cell = mask[row * columns + column];
+                if (farX*farX + farY*farY <= reach*reach)
+                    cell = BlockedCell;
+                else if (nearX*nearX + nearY*nearY <= reach*reach)
+                    cell = qMax(cell, (quint8)BorderCell);
+            }
+    }
+
+    // every chunk draws positions with its own generator seeded from the world one
+    struct SpawnChunk
+    {
+        int first;
+        int count;
+        quint32 seed;
+    };
+    QVector<SpawnChunk> chunks;
+    randomAccess.lock();
+    for (int first = 0; first < count; first += SPAWN_CHUNK_SIZE)
+        chunks.append({first, qMin(SPAWN_CHUNK_SIZE, count - first), random.generate()});
+    randomAccess.unlock();
+
+    qint32 minX = (qint32)(minXcoord() + margin);
+    qint32 maxX = (qint32)(maxXcoord() - margin);
+    qint32 minY = (qint32)(minYcoord() + margin);
+    qint32 maxY = (qint32)(maxYcoord() - margin);
+
+    QVector<QPointF> positions(count);
+    QPointF* out = positions.data();
+    const quint8* cells = mask.constData();
+    std::atomic<int> unplaced(0);
+    blockingMapOn(&tickPool, chunks, [&, out, cells](const SpawnChunk& chunk)
+    {
+        QRandomGenerator generator(chunk.seed);
+        for (int i=0; i<chunk.count; i++)
         {
-            ok = true;
-            pos = randomWorldCoord(10);
-            foreach (WorldObject* resPo, pResources)
-                if (resPo->collaide(pos, 10))
-                {
-                    ok = false;
-                }
-            foreach (WorldObject* resPo, pWarehouse)
-                if (resPo->collaide(pos, 10))
-                {
-                    ok = false;
-                }
+            QPointF pos;
+            bool placed = false;
+            for (int attempt = 0; attempt < SPAWN_MAX_ATTEMPTS && !placed; attempt++)
+            {
+                pos = QPointF(generator.bounded(minX, maxX), generator.bounded(minY, maxY));
+                int column = ((int)pos.x() - bound.left()) / SPAWN_MASK_CELL;
+                int row = ((int)pos.y() - bound.top()) / SPAWN_MASK_CELL;
+                quint8 cell = cells[row * columns + column];
+                if (cell == BlockedCell)
+                    continue;
+                if (cell == BorderCell && std::any_of(pois.constBegin(), pois.constEnd(),
+                                                      [pos, margin](WorldObject* poi) { return poi->collaide(pos, margin); }))
+                    continue;
+                placed = true;
+            }
+            if (!placed)
+            {
+                // world too crowded by POIs for this margin
+                pos = QPointF(qQNaN(), qQNaN());
+                unplaced++;
+            }
+            out[chunk.first + i] = pos;
+        }
+    });
+    if (unplaced)
+        qWarning("%d of %d agents found no free place in %d attempts and were not spawned",
+                 unplaced.load(), count, SPAWN_MAX_ATTEMPTS);
 
-        } while (!ok);
+    QVector<Agent*> created;
+    created.reserve(count);
+    foreach (QPointF pos, positions)
+    {
+        if (qIsNaN(pos.x()))
+            continue;
+        // every process of a split world draws the same positions and keeps its own
+        if (domain && !domain->owns(pos))
+            continue;
+        created.append(createAgent(pos));
+    }
 
-        generateNewAgent( pos );
+    agentListAccess.lock();
+    agents.reserve(agents.count() + created.count());
+    foreach (Agent* agent, created)
+    {
+        agents.append(agent);
+        regions[regionIndexAt(agent->pos())].agents.append(agent);
+    }
+    agentListAccess.unlock();
+
+    lifecycleAccess.lock();
+    pendingLifecycle.created += created;
+    tickBirths += created.count();
+    lifecycleAccess.unlock();
+
+    return created;
+}
+
+void World::onStart()
+{
+    stopRequested = false;
+    if (domain && !domain->connectPeers())
+    {
+        qWarning("failed to connect split world domains");
+        stopRequested = true;
+        return;
+    }
+
+    if (scenarioLoaded)
+    {
+        foreach (WorldObject* poi, pWarehouse)
+            emit warehouseAppeared(poi);
+        foreach (WorldObject* poi, pResources)
+            emit resourceAppeared(poi);
+    }
+    else
+    {
+        for (int i=0;i<3;i++)
+            onNewWarehouseRequest();
+
+        for (int i=0;i <5; i++)
+            onNewResourceRequest();
+
+        spawnAgents(initialAgentsCount, 10);
     }
 
 
@@ -78,7 +257,7 @@ void World::write(QJsonObject &json) const
     json["size"] = sz;
 
     QJsonArray agentsArray;
-    forEachAgent([&agentsArray](const Agent* agent)
+    forEachAgentReadOnly([&agentsArray](const Agent* agent)
     {
         QJsonObject agentJson;
         agent->write(agentJson);
@@ -103,6 +282,125 @@ void World::write(QJsonObject &json) const
         warehousesArray.append(poiJson);
     });
     json["warehouses"] = warehousesArray;
+
+    QJsonObject parameters;
+    parameters["shout_range"] = agentShoutRange;
+    parameters["agent_price"] = (int)newAgentPrice;
+    parameters["separation"] = agentSeparation.load();
+    parameters["incremental_shouting"] = incrementalShouting.load();
+    parameters["communication"] = communicationModel == CommunicationModel::Diffusion ? "diffusion" : "acoustic";
+    json["parameters"] = parameters;
+}
+
+void World::loadScenario(const QString& fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        throw std::runtime_error(QString("can't read %1: %2").arg(fileName, file.errorString()).toStdString());
+
+    ScenarioReader reader(file, fileName);
+    QSize scenarioSize = size;
+    QJsonObject parameters;
+    QVector<Agent*> loadedAgents;
+    // "agents" is read before "parameters", these get the scenario's shout range once it is known
+    QVector<Agent*> defaultRangeAgents;
+    QVector<WorldObject*> loadedResources;
+    QVector<WorldObject*> loadedWarehouses;
+
+    auto readPois = [&reader](QVector<WorldObject*>& pois, const char* color)
+    {
+        reader.readArray([&reader, &pois, color]()
+        {
+            QJsonObject json = reader.readValue().toObject();
+            // depleted objects are written as {}
+            if (!json.contains("position"))
+                return;
+            WorldObject* poi = new WorldObject;
+            poi->setColor(color);
+            poi->read(json);
+            pois.append(poi);
+        });
+    };
+
+    try
+    {
+        // keys come in any order (QJsonDocument sorts them), so size is applied after everything is read
+        reader.readObject([&](const QString& key)
+        {
+            if (key == "size")
+            {
+                QJsonObject json = reader.readValue().toObject();
+                scenarioSize = QSize(json["width"].toInt(size.width()), json["height"].toInt(size.height()));
+            }
+            else if (key == "parameters")
+                parameters = reader.readValue().toObject();
+            else if (key == "agents")
+            {
+                reader.readArray([&]()
+                {
+                    QJsonObject json = reader.readValue().toObject();
+                    if (!json.contains("position"))
+                        return;
+                    QJsonObject position = json["position"].toObject();
+                    Agent* agent = createAgent(QPointF(position["x"].toDouble(), position["y"].toDouble()));
+                    agent->read(json);
+                    loadedAgents.append(agent);
+                    if (!json.contains("shout_range"))
+                        defaultRangeAgents.append(agent);
+                });
+            }
+            else if (key == "resources")
+                readPois(loadedResources, "blue");
+            else if (key == "warehouses")
+                readPois(loadedWarehouses, "orange");
+            else
+                reader.skipValue();
+        });
+        reader.finish();
+    }
+    catch (const std::runtime_error&)
+    {
+        qDeleteAll(loadedAgents);
+        qDeleteAll(loadedResources);
+        qDeleteAll(loadedWarehouses);
+        throw;
+    }
+
+    setWorldSize(scenarioSize);
+    agentShoutRange = parameters["shout_range"].toDouble(agentShoutRange);
+    foreach (Agent* agent, defaultRangeAgents)
+        agent->setShoutingRange(agentShoutRange);
+    newAgentPrice = parameters["agent_price"].toInt(newAgentPrice);
+    agentSeparation = parameters["separation"].toBool(agentSeparation);
+    incrementalShouting = parameters["incremental_shouting"].toBool(incrementalShouting);
+    if (parameters.contains("communication"))
+        communicationModel = parameters["communication"].toString() == "diffusion" ? CommunicationModel::Diffusion
+                                                                                  : CommunicationModel::Acoustic;
+    buildRegions();
+
+    foreach (WorldObject* poi, loadedResources)
+    {
+        poi->setSerialNumber(++poiSerialCounter);
+        pResources.append(poi);
+    }
+    foreach (WorldObject* poi, loadedWarehouses)
+    {
+        poi->setSerialNumber(++poiSerialCounter);
+        pWarehouse.append(poi);
+    }
+
+    agentListAccess.lock();
+    agents += loadedAgents;
+    foreach (Agent* agent, loadedAgents)
+        regions[regionIndexAt(agent->pos())].agents.append(agent);
+    agentListAccess.unlock();
+
+    // avatars are built by the first tick's lifecycle notification; loaded agents are not births
+    lifecycleAccess.lock();
+    pendingLifecycle.created += loadedAgents;
+    lifecycleAccess.unlock();
+
+    scenarioLoaded = true;
 }
 
 WorldObject* World::generateResource()
@@ -128,16 +426,39 @@ WorldObject* World::generateWarehouse()
 }
 
 World::World(QObject *parent)
-    :QObject(parent), size(DEFAULT_WORLD_SIZE)
+    :QObject(parent), size(DEFAULT_WORLD_SIZE), random(QRandomGenerator::system()->generate()),
+      agentSeeds(QRandomGenerator::system()->generate())
 #if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
     ,agentListAccess(QMutex::Recursive)
 #endif
 {
     acousticSpace = new AcousticSpace(boundRect().toRect());
+    diffusionField = new DiffusionField(boundRect().toRect());
+    neighborGrid = new NeighborGrid(boundRect());
+    trafficMap = new TrafficMap(boundRect().toRect());
+    tickRing = new SampleRing<TickSample>;
+    workerThreads = tickPool.maxThreadCount();
+    buildRegions();
+    resetTuner();
 
     agents.append(QVector<Agent*>());
 
-    connect (this, &World::requestNewAgent, this, &World::generateNewAgent, Qt::QueuedConnection);
+    qRegisterMetaType<WorldSummary>();
+    qRegisterMetaType<AgentLifecycle>();
+    qRegisterMetaType<WorldStats>();
+}
+
+World::~World()
+{
+    qDeleteAll(agents);
+    qDeleteAll(ghosts);
+    qDeleteAll(pResources);
+    qDeleteAll(pWarehouse);
+    delete neighborGrid;
+    delete trafficMap;
+    delete diffusionField;
+    delete acousticSpace;
+    delete tickRing;
 }
 
 void World::stop()
@@ -145,6 +466,290 @@ void World::stop()
     stopRequested = true;
 }
 
+/// every other bit of 16 low bits
+static quint32 spreadBits(quint32 v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+static quint32 mortonIndex(QPointF pos, const QRectF& bound)
+{
+    quint32 x = qBound(0.0, (pos.x() - bound.left()) / bound.width(), 1.0) * 0xffff;
+    quint32 y = qBound(0.0, (pos.y() - bound.top()) / bound.height(), 1.0) * 0xffff;
+    return spreadBits(x) | (spreadBits(y) << 1);
+}
+
+void World::reorderAgents()
+{
+    QRectF bound = boundRect();
+    QVector<QPair<quint32, Agent*>> keyed;
+    keyed.reserve(agents.count());
+    int descents = 0;
+    foreach (Agent* agent, agents)
+    {
+        quint32 key = mortonIndex(agent->pos(), bound);
+        if (!keyed.isEmpty() && key < keyed.last().first)
+            descents++;
+        keyed.append(qMakePair(key, agent));
+    }
+    agentDisorder = agents.count() > 1 ? (qreal)descents / (agents.count() - 1) : 0;
+    if (agentDisorder < REORDER_DISORDER_THRESHOLD)
+        return;
+
+    // agents move little between checks, so a sort now keeps the list ordered for many ticks
+    std::sort(keyed.begin(), keyed.end());
+    for (int i=0; i<keyed.count(); i++)
+        agents[i] = keyed[i].second;
+    // regions take agents in list order
+    if (spatialDecomposition)
+        distributeAgents();
+    agentDisorder = 0;
+}
+
+void World::buildRegions()
+{
+    QRect bound = boundRect().toRect();
+    int tilesInRow = (bound.width() + ACOUSTIC_TILE_SIZE - 1) / ACOUSTIC_TILE_SIZE;
+    int tilesInColumn = (bound.height() + ACOUSTIC_TILE_SIZE - 1) / ACOUSTIC_TILE_SIZE;
+
+    // enough regions to keep every thread busy, while regions stay wider than a shout
+    qreal wantedRegions = qMax(1, workerThreads * TUNED_REGIONS_PER_THREAD[regionsLevel]);
+    int tilesInRegionSide = qMax(1, (int)ceil(sqrt(tilesInRow * tilesInColumn / wantedRegions)));
+    regionSide = tilesInRegionSide * ACOUSTIC_TILE_SIZE;
+    while (regionSide < agentShoutRange)
+        regionSide += ACOUSTIC_TILE_SIZE;
+
+    regionsInRow = (bound.width() + regionSide - 1) / regionSide;
+    regionsInColumn = (bound.height() + regionSide - 1) / regionSide;
+
+    regions.clear();
+    regions.resize(regionsInRow * regionsInColumn);
+    for (int y=0; y<regionsInColumn; y++)
+        for (int x=0; x<regionsInRow; x++)
+        {
+            QRect area(bound.left() + x * regionSide, bound.top() + y * regionSide, regionSide, regionSide);
+            regions[y * regionsInRow + x].area = area.intersected(bound);
+        }
+
+    int reach = ceil(agentShoutRange) + 1;
+    for (int i=0; i<regions.count(); i++)
+        for (int j=0; j<regions.count(); j++)
+            if (i != j && regions[i].area.adjusted(-reach, -reach, reach, reach).intersects(regions[j].area))
+                regions[i].neighbours.append(j);
+}
+
+int World::regionIndexAt(QPointF pos) const
+{
+    int x = qBound(0, (int)floor((pos.x() - minXcoord()) / regionSide), regionsInRow - 1);
+    int y = qBound(0, (int)floor((pos.y() - minYcoord()) / regionSide), regionsInColumn - 1);
+    return y * regionsInRow + x;
+}
+
+void World::setSpatialDecomposition(bool on)
+{
+    QMutexLocker lock(&agentListAccess);
+    if (on && !spatialDecomposition)
+        distributeAgents();
+    spatialDecomposition = on;
+}
+
+void World::distributeAgents()
+{
+    for (int i=0; i<regions.count(); i++)
+        regions[i].agents.clear();
+    foreach (Agent* agent, agents)
+        regions[regionIndexAt(agent->pos())].agents.append(agent);
+}
+
+void World::setAutotuning(bool on)
+{
+    QMutexLocker lock(&agentListAccess);
+    if (on && !autotuning)
+        resetTuner();
+    autotuning = on;
+}
+
+void World::setWorkerThreads(int count)
+{
+    QMutexLocker lock(&agentListAccess);
+    workerThreads = qMax(1, count);
+    tickPool.setMaxThreadCount(workerThreads);
+    resetTuner();
+}
+
+void World::setChunkLevel(int level)
+{
+    QMutexLocker lock(&agentListAccess);
+    chunkLevel = qBound(0, level, TUNED_GRANULARITY_LEVELS - 1);
+    resetTuner();
+}
+
+void World::resetTuner()
+{
+    TuneSettings initial;
+    initial.threads = workerThreads;
+    initial.granularity = spatialDecomposition ? regionsLevel : chunkLevel;
+    tuner = TickTuner(qMax(workerThreads, QThread::idealThreadCount()), TUNED_GRANULARITY_LEVELS, initial);
+    tunerDecomposed = spatialDecomposition;
+}
+
+void World::tuneWorkers()
+{
+    if (tunerDecomposed != spatialDecomposition)
+        resetTuner();
+
+    qint64 parallelNs = phaseNs[(int)TickPhase::Move] + phaseNs[(int)TickPhase::Shout]
+                      + phaseNs[(int)TickPhase::Listen];
+    if (!tuner.addTick(parallelNs, agents.count()))
+        return;
+
+    TuneSettings settings = tuner.settings();
+    if (settings.threads != workerThreads)
+    {
+        workerThreads = settings.threads;
+        tickPool.setMaxThreadCount(workerThreads);
+    }
+
+    if (!spatialDecomposition)
+    {
+        chunkLevel = settings.granularity;
+        return;
+    }
+    // regions are rebuilt before the domain exchange, so ghosts land in the new ones
+    regionsLevel = settings.granularity;
+    buildRegions();
+    distributeAgents();
+}
+
+void World::collectHalo(WorldRegion& region) const
+{
+    region.halo.clear();
+    QRectF area(region.area);
+    auto reaches = [&area](const Agent* agent)
+    {
+        qreal reach = agent->shoutingRange() + 1;
+        return area.intersects(QRectF(agent->pos() - QPointF(reach, reach), QSizeF(2*reach, 2*reach)));
+    };
+    foreach (int neighbour, region.neighbours)
+    {
+        foreach (Agent* agent, regions.at(neighbour).agents)
+            if (agent->state() != Agent::Dead && reaches(agent))
+                region.halo.append(agent);
+        foreach (Agent* agent, regions.at(neighbour).ghosts)
+            if (reaches(agent))
+                region.halo.append(agent);
+    }
+}
+
+void World::migrateAgents()
+{
+    for (int i=0; i<regions.count(); i++)
+    {
+        QVector<Agent*>& regionAgents = regions[i].agents;
+        for (int j=regionAgents.count()-1; j>=0; j--)
+        {
+            Agent* agent = regionAgents[j];
+            int target = -1;
+            if (agent->state() != Agent::Dead || agent->avatar()->valid)
+            {
+                target = regionIndexAt(agent->pos());
+                if (target == i)
+                    continue;
+            }
+
+            regionAgents[j] = regionAgents.last();
+            regionAgents.removeLast();
+
+            if (target < 0)
+            {
+                agents.removeOne(agent);
+                retire(agent);
+            }
+            else
+                regions[target].agents.append(agent);
+        }
+    }
+}
+
+void World::decomposedIteration()
+{
+    blockingMapOn(&tickPool, regions, [this](WorldRegion& region)
+    {
+        region.tally = AgentTally();
+        foreach (Agent* agent, region.agents)
+        {
+            if (agent->state() == Agent::Dead)
+            {
+                if (agent->avatar()->valid)
+                    reportDied(agent);
+            }
+            else
+            {
+                agent->move();
+                agent->planShout(acousticSpace->tick(), acousticSpace->isIncremental());
+                tallyAgent(region.tally, agent);
+                if (tickTrafficRecording && agent->state() != Agent::Dead)
+                    trafficMap->count(agent->pos(), agent->state() == Agent::Full ? TrafficChannel::Full : TrafficChannel::Empty);
+            }
+        }
+    });
+
+    migrateAgents();
+    finishPhase(TickPhase::Move);
+
+    if (tickCommunication == CommunicationModel::Diffusion)
+    {
+        // deposits are local, no halo needed
+        blockingMapOn(&tickPool, regions, [this](WorldRegion& region)
+        {
+            foreach (Agent* agent, region.agents)
+                if (agent->state() != Agent::Dead)
+                    agent->diffusionDeposit(*diffusionField);
+            foreach (Agent* agent, region.ghosts)
+                agent->diffusionDeposit(*diffusionField);
+        });
+        diffusionField->relax(agentShoutRange, &tickPool);
+        finishPhase(TickPhase::Shout);
+
+        blockingMapOn(&tickPool, regions, [this](WorldRegion& region)
+        {
+            foreach (Agent* agent, region.agents)
+                if (agent->state() != Agent::Dead)
+                    agent->diffusionListen(*diffusionField);
+        });
+        finishPhase(TickPhase::Listen);
+        return;
+    }
+
+    // every region writes only its own acoustic cells: own agents plus halo from neighbours
+    blockingMapOn(&tickPool, regions, [this](WorldRegion& region)
+    {
+        collectHalo(region);
+        foreach (Agent* agent, region.agents)
+            if (agent->state() != Agent::Dead && agent->shoutsThisTick())
+                agent->acousticShout(*acousticSpace, region.area);
+        foreach (Agent* agent, region.ghosts)
+            agent->acousticShout(*acousticSpace, region.area);
+        foreach (Agent* agent, region.halo)
+            if (agent->shoutsThisTick())
+                agent->acousticShout(*acousticSpace, region.area);
+    });
+    finishPhase(TickPhase::Shout);
+
+    blockingMapOn(&tickPool, regions, [this](WorldRegion& region)
+    {
+        foreach (Agent* agent, region.agents)
+            if (agent->state() != Agent::Dead)
+                agent->acousticListen(*acousticSpace);
+    });
+    finishPhase(TickPhase::Listen);
+}
+
 QSizeF World::worldSize() const
 {
     return size;
@@ -159,9 +764,222 @@ QRectF World::boundRect() const
 
 QPointF World::randomWorldCoord(qreal margin) const
 {
-    QPointF point (QRandomGenerator::system()->bounded((qint32)(minXcoord() + margin), (qint32)(maxXcoord() - margin)),
-                   QRandomGenerator::system()->bounded((qint32)(minYcoord() + margin), (qint32)(maxYcoord() - margin)));
-    return point;
+    QMutexLocker lock(&randomAccess);
+    qint32 x = random.bounded((qint32)(minXcoord() + margin), (qint32)(maxXcoord() - margin));
+    qint32 y = random.bounded((qint32)(minYcoord() + margin), (qint32)(maxYcoord() - margin));
+    return QPointF(x, y);
+}
+
+void World::setSeed(quint32 seed)
+{
+    QMutexLocker lock(&randomAccess);
+    random.seed(seed);
+    agentSeeds.seed(~seed);
+}
+
+quint64 World::nextAgentSeed()
+{
+    QMutexLocker lock(&randomAccess);
+    return agentSeeds.generate64();
+}
+
+void World::setWorldSize(QSize worldSize)
+{
+    size = worldSize;
+    delete acousticSpace;
+    acousticSpace = new AcousticSpace(boundRect().toRect());
+    delete diffusionField;
+    diffusionField = new DiffusionField(boundRect().toRect());
+    delete neighborGrid;
+    neighborGrid = new NeighborGrid(boundRect());
+    delete trafficMap;
+    trafficMap = new TrafficMap(boundRect().toRect());
+    buildRegions();
+}
+
+void World::setAgentShoutRange(qreal range)
+{
+    agentShoutRange = range;
+    buildRegions();
+}
+
+void World::setDomain(DomainLink* link)
+{
+    domain = link;
+    if (domain)
+        setSpatialDecomposition(true);
+}
+
+int World::aliveAgentsCount() const
+{
+    int count = 0;
+    forEachAgent([&count](const Agent* agent)
+    {
+        if (agent->state() != Agent::Dead)
+            count++;
+    });
+    return count;
+}
+
+QVector<Agent*> World::takeAgents(std::function<bool(const Agent*)> predicate)
+{
+    QMutexLocker lock(&agentListAccess);
+    QVector<Agent*> taken;
+    for (int i=agents.count()-1; i>=0; i--)
+    {
+        Agent* agent = agents[i];
+        if (!predicate(agent))
+            continue;
+        agents.removeAt(i);
+        regions[regionIndexAt(agent->pos())].agents.removeOne(agent);
+        retire(agent);
+        taken.append(agent);
+    }
+    return taken;
+}
+
+Agent* World::acceptAgent(const QJsonObject& json)
+{
+    QPointF pos(json["position"].toObject()["x"].toDouble(), json["position"].toObject()["y"].toDouble());
+    Agent* agent = generateNewAgent(pos);
+    if (agent)
+    {
+        QMutexLocker lock(&agentListAccess);
+        agent->read(json);
+    }
+    return agent;
+}
+
+void World::setGhosts(const QVector<DomainGhost>& states)
+{
+    for (int i=0; i<regions.count(); i++)
+        regions[i].ghosts.clear();
+
+    while (ghosts.count() < states.count())
+        ghosts.append(Agent::createGhost(this, states[ghosts.count()].pos));
+
+    for (int i=0; i<states.count(); i++)
+    {
+        Agent* ghost = ghosts[i];
+        ghost->setPos(states[i].pos);
+        ghost->setShoutingRange(states[i].shoutRange);
+        ghost->setDistances(states[i].distanceToResource, states[i].distanceToWarehouse);
+        regions[regionIndexAt(ghost->pos())].ghosts.append(ghost);
+    }
+}
+
+QVector<DomainPoiState> World::poiStates() const
+{
+    QVector<DomainPoiState> states;
+    auto append = [&states](const WorldObject* poi, bool warehouse)
+    {
+        DomainPoiState state;
+        state.serial = poi->serialNumber();
+        state.warehouse = warehouse;
+        state.valid = poi->isValid();
+        state.pos = poi->pos();
+        state.radius = poi->radius();
+        state.volume = poi->volume();
+        state.capacity = poi->capacity();
+        states.append(state);
+    };
+    forEachResource([&append](const WorldObject* poi) { append(poi, false); });
+    forEachWarehouse([&append](const WorldObject* poi) { append(poi, true); });
+    return states;
+}
+
+void World::applyPoiStates(const QVector<DomainPoiState>& states)
+{
+    QHash<quint32, WorldObject*> known;
+    forEachResource([&known](WorldObject* poi) { known[poi->serialNumber()] = poi; });
+    forEachWarehouse([&known](WorldObject* poi) { known[poi->serialNumber()] = poi; });
+
+    QSet<quint32> listed;
+    foreach (const DomainPoiState& state, states)
+    {
+        listed.insert(state.serial);
+        WorldObject* poi = known.value(state.serial);
+        if (!poi)
+        {
+            if (!state.valid)
+                continue;
+            poi = new WorldObject;
+            poi->setSerialNumber(state.serial)
+                .setColor(state.warehouse ? "orange" : "blue");
+        }
+
+        poi->setPos(state.pos)
+            .setRadius(state.radius)
+            .setVolume(state.volume)
+            .setCapacity(state.capacity);
+
+        if (!known.contains(state.serial))
+        {
+            if (state.warehouse)
+            {
+                warehouseAccess.lock();
+                pWarehouse.append(poi);
+                warehouseAccess.unlock();
+                emit warehouseAppeared(poi);
+            }
+            else
+            {
+                resourcesAccess.lock();
+                pResources.append(poi);
+                resourcesAccess.unlock();
+                emit resourceAppeared(poi);
+            }
+        }
+        else if (!state.valid && poi->isValid())
+        {
+            emit resourceDepleted(poi);
+            poi->invalidate();
+        }
+    }
+
+    forEachResource([this, &listed](WorldObject* poi)
+    {
+        if (poi->isValid() && !listed.contains(poi->serialNumber()))
+        {
+            emit resourceDepleted(poi);
+            poi->invalidate();
+        }
+    });
+}
+
+void World::applyPoiChanges(const QHash<quint32, qreal>& volumeChanges, const QSet<quint32>& depleted)
+{
+    QHash<quint32, WorldObject*> resources;
+    QHash<quint32, WorldObject*> warehouses;
+    forEachResource([&resources](WorldObject* poi) { resources[poi->serialNumber()] = poi; });
+    forEachWarehouse([&warehouses](WorldObject* poi) { warehouses[poi->serialNumber()] = poi; });
+
+    for (auto it = volumeChanges.constBegin(); it != volumeChanges.constEnd(); ++it)
+    {
+        if (resources.contains(it.key()))
+        {
+            WorldObject* poi = resources[it.key()];
+            poi->decVolume(-it.value());
+            poi->setRadius (sqrt(poi->volume() / PI));
+        }
+        else if (warehouses.contains(it.key()))
+        {
+            WorldObject* poi = warehouses[it.key()];
+            poi->incVolume(it.value());
+            spawnAgentsFromWarehouse(poi);
+        }
+    }
+
+    foreach (quint32 serial, depleted)
+    {
+        WorldObject* poi = resources.value(serial);
+        if (poi && poi->isValid())
+        {
+            emit resourceDepleted(poi);
+            poi->invalidate();
+            onNewResourceRequest();
+        }
+    }
 }
 
 qreal World::minXcoord() const
@@ -213,13 +1031,20 @@ qreal World::grabResource(WorldObject *poi, qreal capacity)
     if (poi->isValid())
     {
         ret = poi->decVolume(capacity);
+        if (domain)
+            domain->recordVolumeChange(poi, -ret);
 
         if (poi->volume() < capacity)
         {
             emit resourceDepleted(poi);
             poi->invalidate();
             //delete poi;
-            onNewResourceRequest();
+
+            // only the coordinator of split world creates resources
+            if (!domain || domain->isCoordinator())
+                onNewResourceRequest();
+            else
+                domain->recordDepletion(poi);
         }
         else
         {
@@ -234,17 +1059,123 @@ qreal World::dropResource(WorldObject* wo, qreal volume)
     qreal ret = 0;
     wo->incVolume(volume);
 
+    lifecycleAccess.lock();
+    tickDelivered += volume;
+    fedWarehouses.append(wo);
+    lifecycleAccess.unlock();
+
+    if (domain)
+        domain->recordVolumeChange(wo, volume);
+
+    return ret;
+}
+
+void World::settleWarehouses()
+{
+    lifecycleAccess.lock();
+    QVector<WorldObject*> fed;
+    fed.swap(fedWarehouses);
+    lifecycleAccess.unlock();
+
+    // only the coordinator of split world creates agents
+    if (domain && !domain->isCoordinator())
+        return;
+
+    // all drops of the tick are in, so agents born don't depend on the order workers dropped in
+    std::sort(fed.begin(), fed.end());
+    fed.erase(std::unique(fed.begin(), fed.end()), fed.end());
+    foreach (WorldObject* wo, fed)
+        spawnAgentsFromWarehouse(wo);
+}
+
+void World::spawnAgentsFromWarehouse(WorldObject* wo)
+{
     if (wo->volume() > WAREHOUSE_RESOURCES_TO_GENERATE_NEW_AGENTS)
     {
-        while (wo->tryDecVolume(NEW_AGENT_RESOURCES_PRICE) )
+        // agents are created at the end of the tick
+        QMutexLocker lock(&lifecycleAccess);
+        while (wo->tryDecVolume(newAgentPrice) )
         {
-            emit requestNewAgent(wo->pos() + QPointF(wo->radius()+3, 0));
+            pendingSpawns.append(wo->pos() + QPointF(wo->radius()+3, 0));
         }
     }
 
     wo->setRadius (sqrt(qMax(wo->volume(), wo->capacity()) / PI));
+}
 
-    return ret;
+void World::reportDied(Agent* agent)
+{
+    agent->avatar()->valid = false;
+
+    QMutexLocker lock(&lifecycleAccess);
+    pendingLifecycle.died.append(agent);
+    tickDeaths++;
+}
+
+void World::retire(Agent* agent)
+{
+    agent->markLeaked();
+
+    QMutexLocker lock(&lifecycleAccess);
+    retiredAgents.append(tick, agent);
+}
+
+void World::retireDepletedResources()
+{
+    QMutexLocker lock(&resourcesAccess);
+    for (int i = pResources.count() - 1; i >= 0; i--)
+    {
+        WorldObject* poi = pResources[i];
+        if (poi->isValid())
+            continue;
+        pResources.removeAt(i);
+        retiredResources.append(tick, poi);
+    }
+}
+
+void World::reclaimRetired()
+{
+    // incremental acoustic field keeps senders audible for ACOUSTIC_BROADCAST_TTL ticks after they shouted
+    quint64 safeEpoch = tick;
+    if (acousticSpace->isIncremental())
+        safeEpoch = tick > ACOUSTIC_BROADCAST_TTL ? tick - ACOUSTIC_BROADCAST_TTL - 1 : 0;
+    safeEpoch = qMin(safeEpoch, reclaimer.oldestReader());
+
+    retiredResources.reclaim(safeEpoch);
+    QMutexLocker lock(&lifecycleAccess);
+    retiredAgents.reclaim(safeEpoch);
+}
+
+void World::spawnPendingAgents()
+{
+    lifecycleAccess.lock();
+    QVector<QPointF> spawns;
+    spawns.swap(pendingSpawns);
+    lifecycleAccess.unlock();
+
+    // drops arrive in worker order, agents draw their seeds in an order that doesn't depend on it
+    std::sort(spawns.begin(), spawns.end(), [](QPointF a, QPointF b)
+    {
+        return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+    });
+
+    foreach (QPointF pos, spawns)
+        generateNewAgent(pos);
+}
+
+void World::publishLifecycle()
+{
+    AgentLifecycle changes;
+    lifecycleAccess.lock();
+    std::swap(changes, pendingLifecycle);
+    lifecycleAccess.unlock();
+
+    // headless runs have nobody to tell, changes are dropped so they don't pile up;
+    // a receiver gets empty batches too, handling one tells it everything before that tick has arrived
+    if (!isSignalConnected(QMetaMethod::fromSignal(&World::agentsChanged)))
+        return;
+    changes.tick = tick;
+    emit agentsChanged(changes);
 }
 
 void World::onNewCommunication(Agent* a, Agent* b)
@@ -256,53 +1187,138 @@ void World::onNewCommunication(Agent* a, Agent* b)
 
 void World::iteration()
 {
+    tickLatenessNs = pacer.isPaced() ? pacer.waitNextDeadline() : -1;
+
     QElapsedTimer calcTime;
     calcTime.start();
-    emit iterationStart();
-
-    foreach (WorldObject* poi, pResources)
-    {
-        if (poi->isValid())
-            continue;
-        pResources.removeOne(poi);
-        delete poi;
-    }
+    phaseTimer.start();
+    std::fill(phaseNs, phaseNs + TICK_PHASES_COUNT, 0);
+    if (!batchMode)
+        emit iterationStart();
 
+    retireDepletedResources();
 
     commLinesAccess.lock();
     communicatedAgents.clear();
     commLinesAccess.unlock();
 
+    CommunicationModel model = communicationModel;
+    if (model != tickCommunication && model == CommunicationModel::Diffusion)
+        diffusionField->clear();
+    tickCommunication = model;
+    tickSeparation = agentSeparation;
+    tickReordering = localityReordering;
+    tickTrafficRecording = trafficRecording;
+    acousticSpace->setIncremental(incrementalShouting && tickCommunication == CommunicationModel::Acoustic);
     acousticSpace->clear();
+    reclaimRetired();
 
     agentListAccess.lock();
 
-    auto agentActions = [this](Agent* agent)
+    if (tickReordering && tick % REORDER_CHECK_TICKS == 0)
+        reorderAgents();
+    // only separation queries the grid, a stale one is emptied so it holds no agents that may be freed
+    if (tickSeparation)
+        neighborGrid->rebuild(agents);
+    else if (neighborGrid->count())
+        neighborGrid->rebuild(QVector<Agent*>());
+    finishPhase(TickPhase::Prepare);
+
+    QMutex removedAccess;
+    QVector<Agent*> removed;
+    auto agentActions = [this, &removedAccess, &removed](Agent* agent, AgentTally& tally)
     {
         {
             if (agent->state() == Agent::Dead)
             {
                 if (agent->avatar()->valid)
-                {
-                    agent->avatar()->valid = false;
-                    emit agentDied(agent);
-                }
+                    reportDied(agent);
                 else
                 {
-                    agents.removeOne(agent);
+                    // other workers walk the list, it's shortened after the walk
+                    removedAccess.lock();
+                    removed.append(agent);
+                    removedAccess.unlock();
                     //delete agent;
                 }
             }
             else
             {
                 agent->move();
-                agent->acousticShout(*acousticSpace);
-                agent->acousticListen(*acousticSpace);
+                agent->planShout(acousticSpace->tick(), acousticSpace->isIncremental());
+                // died of age while moving: silent from now on, as in decomposed tick
+                if (agent->state() == Agent::Dead)
+                    return;
+                tallyAgent(tally, agent);
+                if (tickTrafficRecording)
+                    trafficMap->count(agent->pos(), agent->state() == Agent::Full ? TrafficChannel::Full : TrafficChannel::Empty);
+                // listening has to wait until everybody has shouted or the field is relaxed
+                if (tickCommunication == CommunicationModel::Diffusion)
+                    agent->diffusionDeposit(*diffusionField);
+                else if (agent->shoutsThisTick())
+                    agent->acousticShout(*acousticSpace);
             }
         }
     };
 
-    QtConcurrent::blockingMap(agents, agentActions);
+    AgentTally tally;
+    if (spatialDecomposition)
+    {
+        decomposedIteration();
+        foreach (const WorldRegion& region, regions)
+            addTally(tally, region.tally);
+    }
+    else
+    {
+        int chunkSize = TUNED_CHUNK_SIZES[chunkLevel];
+        // every chunk tallies its agents while moving them, as regions do
+        QVector<QPair<int, int>> chunks = agentChunks(chunkSize);
+        QVector<AgentTally> chunkTallies(chunks.count());
+        QVector<int> chunkIndices(chunks.count());
+        std::iota(chunkIndices.begin(), chunkIndices.end(), 0);
+        Agent* const* items = agents.constData();
+        const QPair<int, int>* ranges = chunks.constData();
+        AgentTally* tallies = chunkTallies.data();
+        blockingMapOn(&tickPool, chunkIndices, [&](int c)
+        {
+            for (int i = ranges[c].first; i < ranges[c].second; i++)
+                agentActions(items[i], tallies[c]);
+        });
+        foreach (const AgentTally& part, chunkTallies)
+            addTally(tally, part);
+        if (!removed.isEmpty())
+        {
+            std::sort(removed.begin(), removed.end());
+            agents.erase(std::remove_if(agents.begin(), agents.end(), [&removed](Agent* agent)
+            {
+                return std::binary_search(removed.constBegin(), removed.constEnd(), agent);
+            }), agents.end());
+            foreach (Agent* agent, removed)
+                retire(agent);
+        }
+
+        if (tickCommunication == CommunicationModel::Diffusion)
+        {
+            diffusionField->relax(agentShoutRange, &tickPool);
+            parallelForEachAgent([this](Agent* agent)
+            {
+                if (agent->state() != Agent::Dead)
+                    agent->diffusionListen(*diffusionField);
+            }, chunkSize);
+        }
+        else
+        {
+            // what an agent hears must not depend on which neighbours happened to shout before
+            parallelForEachAgent([this](Agent* agent)
+            {
+                if (agent->state() != Agent::Dead)
+                    agent->acousticListen(*acousticSpace);
+            }, chunkSize);
+        }
+        finishPhase(TickPhase::Move);
+    }
+    if (autotuning)
+        tuneWorkers();
 
     agentListAccess.unlock();
 
@@ -319,13 +1335,210 @@ void World::iteration()
 //    agent->acousticListen(*acousticSpace);
 //    });
 
-    emit iterationEnd(calcTime.elapsed());
-    //usleep(GRANULARITY_US);
+    commLinesAccess.lock();
+    MemoryAccounting::set(MemorySubsystem::CommunicationLines,
+                          communicatedAgents.capacity() * sizeof(QPair<const Agent*, const Agent*>),
+                          communicatedAgents.count());
+    commLinesAccess.unlock();
+
+    settleWarehouses();
+    if (domain && !domain->exchange(*this))
+    {
+        qWarning("split world domain is lost, stopping");
+        stopRequested = true;
+    }
+
+    spawnPendingAgents();
+    if (tickTrafficRecording)
+        trafficMap->merge();
+    finishPhase(TickPhase::Exchange);
+
+    tick++;
+    publishStats(tally, calcTime.nsecsElapsed());
+
+    agentListAccess.lock();
+    publishedAgentsAccess.lock();
+    publishedAgents = agents;
+    publishedAgentsAccess.unlock();
+    agentListAccess.unlock();
+    reclaimer.advance(tick);
+
+    if (snapshots && snapshots->due())
+        publishSnapshot();
+    if (exporter && exporter->due(tick))
+        exportFrame();
+    if (!batchMode)
+    {
+        publishLifecycle();
+        emit iterationEnd(calcTime.elapsed());
+    }
+    else if (tick % LIFECYCLE_BATCH_TICKS == 0)
+        publishLifecycle();
+}
+
+void World::runUntil(quint64 lastTick)
+{
+    if (tick < lastTick)
+        advance(lastTick - tick);
+    emit finished();
+}
+
+void World::advance(quint64 ticks)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    quint64 firstTick = tick;
+    batchMode = true;
+    while (tick - firstTick < ticks && !stopRequested)
+        iteration();
+    batchMode = false;
+    publishLifecycle();
+
+    WorldSummary s = summary();
+    s.ticksAdvanced = tick - firstTick;
+    s.elapsedMs = timer.elapsed();
+    emit advanced(s);
+}
+
+WorldSummary World::summary() const
+{
+    WorldStats last = stats();
+    WorldSummary s;
+    s.tick = tick;
+    s.emptyAgentsCount = last.emptyAgentsCount;
+    s.fullAgentsCount = last.fullAgentsCount;
+    s.agentsCount = last.agentsCount();
+    s.warehouseVolume = last.warehouseVolume;
+    return s;
+}
+
+void World::fillSnapshot()
+{
+    snapshotAgents.resize(0);
+    forEachAgent([this](const Agent* agent)
+    {
+        Agent::State state = agent->state();
+        if (state == Agent::Dead)
+            return;
+        snapshotAgents.append({(float)agent->pos().x(), (float)agent->pos().y(), (float)agent->direction(),
+                               (quint32)state});
+    });
+
+    snapshotPois.resize(0);
+    auto append = [this](const WorldObject* poi, bool warehouse)
+    {
+        if (poi->isValid())
+            snapshotPois.append({(float)poi->pos().x(), (float)poi->pos().y(), (float)poi->radius(),
+                                 (float)poi->volume(), (float)poi->capacity(), warehouse});
+    };
+    forEachResource([&append](const WorldObject* poi) { append(poi, false); });
+    forEachWarehouse([&append](const WorldObject* poi) { append(poi, true); });
+
+}
+
+void World::publishSnapshot()
+{
+    fillSnapshot();
+    snapshots->write(tick, snapshotAgents, snapshotPois);
+}
+
+void World::exportFrame()
+{
+    // nothing is copied for a frame that would be dropped
+    if (!exporter->reserve())
+        return;
+
+    ExportFrame frame;
+    fillSnapshot();
+    frame.snapshot.tick = tick;
+    frame.snapshot.agents = snapshotAgents;
+    frame.snapshot.pois = snapshotPois;
+    if (exporter->wantsCommLines())
+    {
+        commLinesAccess.lock();
+        for (const auto& line : qAsConst(communicatedAgents))
+            (line.first->state() == Agent::Empty ? frame.emptyLines : frame.fullLines)
+                .append(QLineF(line.first->pos(), line.second->pos()));
+        commLinesAccess.unlock();
+    }
+    exporter->submit(frame);
+}
+
+QVector<QPair<int, int>> World::agentChunks(int chunkSize) const
+{
+    QVector<QPair<int, int>> chunks;
+    chunkSize = qMax(1, chunkSize);
+    for (int first = 0; first < agents.count(); first += chunkSize)
+        chunks.append(qMakePair(first, qMin(first + chunkSize, agents.count())));
+    return chunks;
+}
+
+WorldStats World::stats() const
+{
+    QMutexLocker lock(&statsAccess);
+    return lastStats;
+}
+
+void World::finishPhase(TickPhase phase)
+{
+    phaseNs[(int)phase] += phaseTimer.nsecsElapsed();
+    phaseTimer.start();
+}
+
+void World::publishStats(const AgentTally& tally, qint64 tickNs)
+{
+    WorldStats s;
+    s.tick = tick;
+    s.tickNs = tickNs;
+    std::copy(phaseNs, phaseNs + TICK_PHASES_COUNT, s.phaseNs);
+    foreach (const WorldObject* resource, pResources)
+        if (resource->isValid())
+            s.resourcesCount++;
+    s.warehousesCount = pWarehouse.count();
+    s.emptyAgentsCount = tally.emptyAgentsCount;
+    s.fullAgentsCount = tally.fullAgentsCount;
+    if (s.agentsCount())
+        s.meanTtl = (qreal)tally.ttlSum / s.agentsCount();
+    s.shoutsCount = tally.shoutsCount;
+    s.agentDisorder = tickReordering ? agentDisorder : 0;
+    s.latenessNs = tickLatenessNs;
+    s.deadlineMisses = pacer.missed();
+    s.workerThreads = workerThreads;
+    s.chunkSize = spatialDecomposition ? agents.count() / qMax(1, regions.count()) : TUNED_CHUNK_SIZES[chunkLevel];
+    foreach (const WorldObject* warehouse, pWarehouse)
+        s.warehouseVolume += warehouse->volume();
+
+    lifecycleAccess.lock();
+    s.retiredCount = retiredAgents.count() + retiredResources.count();
+    s.births = tickBirths;
+    s.deaths = tickDeaths;
+    s.resourcesDelivered = tickDelivered;
+    tickBirths = 0;
+    tickDeaths = 0;
+    tickDelivered = 0;
+    lifecycleAccess.unlock();
+
+    statsAccess.lock();
+    s.totalBirths = lastStats.totalBirths + s.births;
+    s.totalDeaths = lastStats.totalDeaths + s.deaths;
+    s.totalResourcesDelivered = lastStats.totalResourcesDelivered + s.resourcesDelivered;
+    lastStats = s;
+    statsAccess.unlock();
+
+    TickSample sample;
+    sample.tick = s.tick;
+    sample.atNs = perfClockNs();
+    sample.tickNs = tickNs;
+    sample.agentsCount = s.agentsCount();
+    sample.latenessNs = tickLatenessNs;
+    tickRing->push(sample);
 }
 
 void World::onNewResourceRequest()
 {
     WorldObject* resource = generateResource();
+    resource->setSerialNumber(++poiSerialCounter);
     pResources.append( resource );
 
     emit resourceAppeared (resource);
@@ -334,6 +1547,7 @@ void World::onNewResourceRequest()
 void World::onNewWarehouseRequest()
 {
     auto ptr = generateWarehouse();
+    ptr->setSerialNumber(++poiSerialCounter);
     pWarehouse.append(ptr);
 
     emit warehouseAppeared(ptr);
@@ -2,6 +2,18 @@
 #define WORLD_H
 
 #include "poi.h"
+#include "acousticspace.h"
+#include "diffusionfield.h"
+#include "trafficmap.h"
+#include "domain.h"
+#include "neighborgrid.h"
+#include "sharedsnapshot.h"
+#include "frameexporter.h"
+#include "epochreclaimer.h"
+#include "perfmonitor.h"
+#include "autotuner.h"
+#include "tickpacer.h"
+#include "poolmap.h"
 
 #include <QSize>
 #include <QPointF>
@@ -17,150 +29,371 @@
 #endif
 #include <QReadWriteLock>
 #include <QMap>
+#include <QRandomGenerator>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+
+#include <functional>
+#include <atomic>
 
 #include <math.h>
 
 const quint16 AGENTS_COUNT = 500;
-const quint16 GRANULARITY_US = 1000;
 const quint32 WAREHOUSE_RESOURCES_TO_GENERATE_NEW_AGENTS = 1000;
 const quint32 NEW_AGENT_RESOURCES_PRICE = 77 ;
 const QSize DEFAULT_WORLD_SIZE = {800, 800};
 const qreal WAREHOUSE_INITIAL_RADIUS = 25;
 const qreal RESOURCE_INITIAL_RADIUS = 25;
 const qreal DEFAULT_INITIAL_AGENT_RADIUS = 5;
+const qreal DEFAULT_AGENT_SHOUT_RANGE = 50;
+const int SPAWN_MASK_CELL = 4;
+const int SPAWN_CHUNK_SIZE = 16384;
+/// random positions tried for an agent before it's given up as one that doesn't fit
+const int SPAWN_MAX_ATTEMPTS = 1000;
+const int PARALLEL_FOR_EACH_CHUNK_SIZE = 4096;
+/// granularity levels the tick is tuned over: agents per task without spatial decomposition
+const int TUNED_CHUNK_SIZES[] = {64, 256, 1024, 4096, 16384};
+/// and regions per worker thread with it
+const int TUNED_REGIONS_PER_THREAD[] = {1, 2, 4, 8, 16};
+const int TUNED_GRANULARITY_LEVELS = 5;
+const int DEFAULT_CHUNK_LEVEL = 3;
+const int DEFAULT_REGIONS_LEVEL = 2;
+/// with locality reordering agent order is checked every REORDER_CHECK_TICKS ticks
+const int REORDER_CHECK_TICKS = 16;
+/// and the list is sorted once this part of consecutive agents is out of Morton order
+const qreal REORDER_DISORDER_THRESHOLD = 0.2;
+/// in batch mode births and deaths are published every LIFECYCLE_BATCH_TICKS ticks
+const int LIFECYCLE_BATCH_TICKS = 100;
 
 class Agent;
 
-struct AcousticMessage
+/// short description of the world state, published instead of per tick signals after fast forward
+struct WorldSummary
 {
-    QMutex minDistanceToResourceAccess;
-    qreal minDistanceToResource = -1;
-    Agent* minDistanceToResourceSender = nullptr;
-
-    QMutex minDistanceToWarehouseAccess;
-    qreal minDistanceToWarehouse = -1;
-    Agent* minDistanceToWarehouseSender = nullptr;
-
-
-    /** For given radius return collection of points with integer coords that reside in circle with this raius and center (0,0)
+    quint64 tick = 0;
+    quint64 ticksAdvanced = 0;
+    qint64 elapsedMs = 0;
+    int agentsCount = 0;
+    int emptyAgentsCount = 0;
+    int fullAgentsCount = 0;
+    qreal warehouseVolume = 0;
+};
+Q_DECLARE_METATYPE(WorldSummary)
 
-        For given radius results should be cached
-    */
-    static const QVector<QPoint>& relativeCoordsCollection(qint32 radius)
-    {
-        static QReadWriteLock lock;
+/// parts of a tick timed separately
+enum class TickPhase {Prepare, Move, Shout, Listen, Exchange};
+const int TICK_PHASES_COUNT = 5;
+const char* tickPhaseName(TickPhase phase);
 
-        static QMap<quint32, QVector<QPoint>> cache;
+/// statistics of one tick, reduced by the workers while the tick runs
+struct WorldStats
+{
+    quint64 tick = 0;
+    qint64 tickNs = 0;
+    /// without spatial decomposition moving, shouting and listening are a single Move phase
+    qint64 phaseNs[TICK_PHASES_COUNT] = {};
+    int resourcesCount = 0;
+    int warehousesCount = 0;
+    int emptyAgentsCount = 0;
+    int fullAgentsCount = 0;
+    int births = 0;
+    int deaths = 0;
+    /// agents and resources removed from the world but not freed yet
+    int retiredCount = 0;
+    /// agents that broadcast their distances, all of them unless shouting is incremental
+    int shoutsCount = 0;
+    /// how late the tick started after its deadline in paced mode, -1 when running free
+    qint64 latenessNs = -1;
+    /// ticks started later than PACER_MISS_TOLERANCE of the period since pacing started
+    quint64 deadlineMisses = 0;
+    /// part of consecutive agents out of Morton order at the last check, 0 without locality reordering
+    qreal agentDisorder = 0;
+    /// thread pool size and mean agents per parallel task, chosen by autotuning
+    int workerThreads = 0;
+    int chunkSize = 0;
+    qreal resourcesDelivered = 0;
+    qreal meanTtl = 0;
+    qreal warehouseVolume = 0;
+
+    /// since the world started
+    quint64 totalBirths = 0;
+    quint64 totalDeaths = 0;
+    qreal totalResourcesDelivered = 0;
+
+    int agentsCount() const {return emptyAgentsCount + fullAgentsCount;}
+};
+Q_DECLARE_METATYPE(WorldStats)
 
-        lock.lockForRead();
-        if (!cache.contains(radius))
-        {
-            lock.unlock();
-            lock.lockForWrite();
-            if (!cache.contains(radius))
-            {
-                for(qint32 x = -radius; x <= radius; x++)
-                    for(qint32 y = -radius; y <= radius; y++)
-                        if ( x*x + y*y <= radius*radius )
-                            cache[radius].append({x,y});
-            }
-        }
-        lock.unlock();
-        return cache[radius];
-    }
+/// partial counts of alive agents made by one worker
+struct AgentTally
+{
+    int emptyAgentsCount = 0;
+    int fullAgentsCount = 0;
+    qint64 ttlSum = 0;
+    int shoutsCount = 0;
 };
 
-class AcousticSpace
+/// agents created and died since the previous notification, delivered to the GUI as a single event
+struct AgentLifecycle
 {
-    AcousticMessage** space = nullptr;
-    QRect boundRect;
-public:
-    AcousticSpace(QRect bound)
-        :boundRect(bound)
-    {
-        space = new AcousticMessage* [bound.width()];
-        for(int x=0; x<bound.width(); x++)
-            space[x] = new AcousticMessage [bound.height()];
-    }
+    quint64 tick = 0;
+    QVector<Agent*> created;
+    QVector<Agent*> died;
 
-    AcousticMessage& cell(QPointF coord)
-    {
-        int x_index = coord.x() - boundRect.left();
-        int y_index = coord.y() - boundRect.top();
-        if (x_index >=0 && y_index >= 0 && x_index < boundRect.width() && y_index<boundRect.height())
-            return space[x_index][y_index];
-        else
-            throw std::range_error("index out of range");
-    }
+    bool isEmpty() const {return created.isEmpty() && died.isEmpty();}
+};
+Q_DECLARE_METATYPE(AgentLifecycle)
 
-    void clear()
-    {
-        for(int x=0; x<boundRect.width(); x++)
-            for(int y=0; y<boundRect.height(); y++)
-            {
-                space[x][y].minDistanceToResourceSender = nullptr;
-                space[x][y].minDistanceToWarehouseSender = nullptr;
-            }
-    }
+/** Rectangular part of the world processed by a single worker during a tick.
 
-    void shout(const AcousticMessage& msg, QPoint pos, int range)
-    {
-        auto& relPointsCollection = AcousticMessage::relativeCoordsCollection(range);
-        foreach(const QPoint& relPoint, relPointsCollection)
-        {
-            QPoint acousticCoord = pos + relPoint;
-            int x_index = acousticCoord.x() - boundRect.left();
-            int y_index = acousticCoord.y() - boundRect.top();
-            if (x_index >=0 && y_index >= 0 && x_index < boundRect.width() && y_index<boundRect.height())
-            {
-                space[x_index][y_index].minDistanceToResourceAccess.lock();
-                if (space[x_index][y_index].minDistanceToResource > msg.minDistanceToResource || !space[x_index][y_index].minDistanceToResourceSender)
-                {
-                    if (space[x_index][y_index].minDistanceToResource > msg.minDistanceToResource || !space[x_index][y_index].minDistanceToResourceSender)
-                    {
-                        space[x_index][y_index].minDistanceToResource = msg.minDistanceToResource;
-                        space[x_index][y_index].minDistanceToResourceSender = msg.minDistanceToResourceSender;
-                    }
-                }
-                space[x_index][y_index].minDistanceToResourceAccess.unlock();
-
-                space[x_index][y_index].minDistanceToWarehouseAccess.lock();
-                if (space[x_index][y_index].minDistanceToWarehouse > msg.minDistanceToWarehouse || !space[x_index][y_index].minDistanceToWarehouseSender)
-                {
-                    if (space[x_index][y_index].minDistanceToWarehouse > msg.minDistanceToWarehouse || !space[x_index][y_index].minDistanceToWarehouseSender)
-                    {
-                        space[x_index][y_index].minDistanceToWarehouse = msg.minDistanceToWarehouse;
-                        space[x_index][y_index].minDistanceToWarehouseSender = msg.minDistanceToWarehouseSender;
-                    }
-                }
-                space[x_index][y_index].minDistanceToWarehouseAccess.unlock();
-            }
-        }
-    }
+    Region area is aligned to acoustic tiles and the region owns acoustic cells inside it:
+    only its own agents and halo agents (neighbours shouting across the border) write there
+*/
+struct WorldRegion
+{
+    QRect area;
+    QVector<Agent*> agents;
+    QVector<Agent*> halo;
+    QVector<Agent*> ghosts;
+    QVector<int> neighbours;
+    AgentTally tally;
 };
 
-
 class World : public QObject
 {
     Q_OBJECT
+    /// copies the whole state to start from
+    friend class ReferenceWorld;
 
     AcousticSpace* acousticSpace = nullptr;
+    DiffusionField* diffusionField = nullptr;
+    NeighborGrid* neighborGrid = nullptr;
+    TrafficMap* trafficMap = nullptr;
+    /// set from any thread, the tick reads it once at its start into tickTrafficRecording
+    std::atomic<bool> trafficRecording {false};
+    bool tickTrafficRecording = false;
 
     QSize size;
     QList<WorldObject*> pResources;
     QList<WorldObject*> pWarehouse;
     //QVector<QVector<Agent*>> agents;
     QVector<Agent*> agents;
+    mutable QMutex publishedAgentsAccess;
+    QVector<Agent*> publishedAgents;
     bool stopRequested = false;
+    bool batchMode = false;
+    int initialAgentsCount = AGENTS_COUNT;
+    bool scenarioLoaded = false;
+
+    bool spatialDecomposition = true;
+    /// set from any thread, the tick reads it once at its start into tickSeparation
+    std::atomic<bool> agentSeparation {false};
+    bool tickSeparation = false;
+    /// set from any thread, applied to the acoustic space at the start of a tick
+    std::atomic<bool> incrementalShouting {false};
+    /// set from any thread, the tick reads it once at its start into tickCommunication
+    std::atomic<CommunicationModel> communicationModel {CommunicationModel::Acoustic};
+    /// model of the running tick, switched only between ticks
+    CommunicationModel tickCommunication = CommunicationModel::Acoustic;
+    qreal agentShoutRange = DEFAULT_AGENT_SHOUT_RANGE;
+    quint32 newAgentPrice = NEW_AGENT_RESOURCES_PRICE;
+    QVector<WorldRegion> regions;
+    int regionSide = 0;
+    int regionsInRow = 0;
+    int regionsInColumn = 0;
+
+    /// set from any thread, the tick reads it once at its start into tickReordering
+    std::atomic<bool> localityReordering {false};
+    bool tickReordering = false;
+    qreal agentDisorder = 0;
+    /// sorts the agent list by Morton index of position if it's disordered enough, agentListAccess is held
+    void reorderAgents();
+
+    void buildRegions();
+    /// puts every agent to the region of its position
+    void distributeAgents();
+    int regionIndexAt(QPointF pos) const;
+    void collectHalo(WorldRegion& region) const;
+    void migrateAgents();
+    void decomposedIteration();
+
+    mutable QMutex randomAccess;
+    mutable QRandomGenerator random;
+    /// separate from random, so agents of a split world don't shift the sequence shared by its processes
+    QRandomGenerator agentSeeds;
+
+    DomainLink* domain = nullptr;
+
+    SnapshotPublisher* snapshots = nullptr;
+    QVector<SnapshotAgent> snapshotAgents;
+    QVector<SnapshotPoi> snapshotPois;
+    void fillSnapshot();
+    void publishSnapshot();
+    FrameExporter* exporter = nullptr;
+    void exportFrame();
+    QVector<Agent*> ghosts;
+    quint64 tick = 0;
+    quint32 poiSerialCounter = 0;
+    quint32 agentSerialCounter = 0;
 
     WorldObject* generateResource();
     WorldObject* generateWarehouse();
+    void spawnAgentsFromWarehouse(WorldObject* wo);
+    Agent* createAgent(QPointF position);
+
+    QMutex lifecycleAccess;
+    AgentLifecycle pendingLifecycle;
+    QVector<QPointF> pendingSpawns;
+    /// warehouses agents dropped resources to during the tick, checked for new agents once the workers are done
+    QVector<WorldObject*> fedWarehouses;
+    void settleWarehouses();
+    int tickBirths = 0;
+    int tickDeaths = 0;
+    qreal tickDelivered = 0;
+    /// agents and resources removed from their lists, deleted once no reader holds them
+    mutable EpochReclaimer reclaimer;
+    RetiredList<Agent> retiredAgents;
+    RetiredList<WorldObject> retiredResources;
+    void retireDepletedResources();
+    void reclaimRetired();
+    void reportDied(Agent* agent);
+    void retire(Agent* agent);
+    void spawnPendingAgents();
+    void publishLifecycle();
+
+    mutable QMutex statsAccess;
+    WorldStats lastStats;
+    SampleRing<TickSample>* tickRing = nullptr;
+    QElapsedTimer phaseTimer;
+    qint64 phaseNs[TICK_PHASES_COUNT] = {};
+    void finishPhase(TickPhase phase);
+    void publishStats(const AgentTally& tally, qint64 tickNs);
+
+    TickPacer pacer;
+    qint64 tickLatenessNs = -1;
+
+    bool autotuning = true;
+    TickTuner tuner{1, 1, TuneSettings()};
+    /// granularity means regions per thread for a decomposed world, chunk size otherwise
+    bool tunerDecomposed = true;
+    /// parallel work of the tick runs here, sized by autotuning without touching the global pool
+    mutable QThreadPool tickPool;
+    int workerThreads = 1;
+    int chunkLevel = DEFAULT_CHUNK_LEVEL;
+    int regionsLevel = DEFAULT_REGIONS_LEVEL;
+    void resetTuner();
+    /// feeds the tuner with the parallel part of the tick, applies new settings, agentListAccess is held
+    void tuneWorkers();
+
+    /// [first, last) index ranges covering the agent list
+    QVector<QPair<int, int>> agentChunks(int chunkSize) const;
 
     QVector<QPair<const Agent*, const Agent*>> communicatedAgents;
 public:
     World(QObject* parent = nullptr);
+    ~World();
     void stop();
 
+    void setSpatialDecomposition(bool on);
+    bool isSpatiallyDecomposed() const {return spatialDecomposition;}
+    int regionsCount() const {return regions.count();}
+    const AcousticSpace& acoustics() const {return *acousticSpace;}
+    const DiffusionField& diffusion() const {return *diffusionField;}
+    /// every tick, fast forward included, for one performance monitor
+    const SampleRing<TickSample>& tickSamples() const {return *tickRing;}
+
+    /// takes effect from the next tick, diffusion field starts empty every time it's switched on
+    void setCommunicationModel(CommunicationModel model) {communicationModel = model;}
+    CommunicationModel communication() const {return communicationModel;}
+
+    /// paced mode: ticks start on deadlines ticksPerSecond apart, 0 runs as fast as possible; set before start
+    void setTickRate(qreal ticksPerSecond) {pacer.setRate(ticksPerSecond);}
+    /// deadline statistics, read only while the world doesn't tick
+    const TickPacer& pacing() const {return pacer;}
+
+    /** Adapt worker thread count and work granularity to the tick, on by default.
+
+        Threads are those of a pool of the world, so worlds running side by side are tuned independently
+    */
+    void setAutotuning(bool on);
+    bool isAutotuningOn() const {return autotuning;}
+    /// threads the tick runs on, autotuning starts from this count
+    void setWorkerThreads(int count);
+    /// index into TUNED_CHUNK_SIZES for the tick without spatial decomposition, autotuning starts from it
+    void setChunkLevel(int level);
+
+    /** Count every tick where alive agents are, separately for empty and full ones, off by default.
+
+        Counting goes on from where it stopped when switched on again
+    */
+    void setTrafficRecording(bool on) {trafficRecording = on;}
+    bool isTrafficRecordingOn() const {return trafficRecording;}
+    /// totals are safe to read and save from any thread
+    const TrafficMap& traffic() const {return *trafficMap;}
+
+    /// agent positions as of the start of current tick, kept only while separation is on and empty otherwise
+    const NeighborGrid& neighbors() const {return *neighborGrid;}
+    QVector<Agent*> neighborsWithin(QPointF pos, qreal r) const {return neighborGrid->neighborsWithin(pos, r);}
+    /** Readers holding agent or resource pointers across ticks (the GUI) register here and report
+        the tick they are done with, so nothing they still hold is freed
+    */
+    EpochReclaimer& reclamation() {return reclaimer;}
+
+    /// agents push each other apart instead of passing through, takes effect from the next tick
+    void setAgentSeparation(bool on) {agentSeparation = on;}
+    bool isAgentSeparationOn() const {return agentSeparation;}
+    /// separation of the running tick
+    bool separatesThisTick() const {return tickSeparation;}
+    /** Keep the agent list sorted along a Morton curve of positions.
+
+        Agents close in the world are then processed close in time, by the same worker, so shouting and listening
+        write and read the same acoustic cells while they are in cache. Only the order changes
+    */
+    void setLocalityReordering(bool on) {localityReordering = on;}
+    bool isLocalityReorderingOn() const {return localityReordering;}
+    /// acoustic field persists between ticks and agents shout only when they know something new,
+    /// takes effect from the next tick
+    void setIncrementalShouting(bool on) {incrementalShouting = on;}
+    bool isIncrementalShoutingOn() const {return incrementalShouting;}
+
+    /// must be called before start, processes of a split world have to share the seed
+    void setSeed(quint32 seed);
+    quint64 nextAgentSeed();
+
+    /// parameters below have to be set before start
+    void setWorldSize(QSize worldSize);
+    void setAgentShoutRange(qreal range);
+    qreal agentShoutingRange() const {return agentShoutRange;}
+    void setNewAgentPrice(quint32 price) {newAgentPrice = price;}
+    quint32 newAgentResourcesPrice() const {return newAgentPrice;}
+    void setDomain(DomainLink* link);
+    /// state is copied to the publisher at the end of a tick, at most once per SNAPSHOT_PUBLISH_INTERVAL_MS
+    void setSnapshotPublisher(SnapshotPublisher* publisher) {snapshots = publisher;}
+    /// every due tick is drawn offscreen and written to disk, ticks never wait for it
+    void setFrameExporter(FrameExporter* frameExporter) {exporter = frameExporter;}
+    quint64 tickCount() const {return tick;}
+    int aliveAgentsCount() const;
+    WorldSummary summary() const;
+    /// statistics of the last finished tick, cheap to call from any thread
+    WorldStats stats() const;
+    void setInitialAgentsCount(int count) {initialAgentsCount = count;}
+
+    /** Place count agents at random free positions at least margin away from resources and warehouses.
+
+        Positions are drawn in parallel against an occupancy mask of POIs, agents are added to the world at once
+        and announced with the next agentsChanged signal. An agent with no free position among SPAWN_MAX_ATTEMPTS
+        draws is left out with a warning, so fewer than count agents may be returned
+    */
+    QVector<Agent*> spawnAgents(int count, quint16 margin);
+
+    /// remove matching agents from the world, they stay readable until the epoch reclaimer frees them
+    QVector<Agent*> takeAgents(std::function<bool(const Agent*)> predicate);
+    Agent* acceptAgent(const QJsonObject& json);
+    void setGhosts(const QVector<DomainGhost>& states);
+    QVector<DomainPoiState> poiStates() const;
+    void applyPoiStates(const QVector<DomainPoiState>& states);
+    void applyPoiChanges(const QHash<quint32, qreal>& volumeChanges, const QSet<quint32>& depleted);
+
     QSizeF worldSize() const;
     QRectF boundRect() const;
     QPointF randomWorldCoord(qreal margin) const;
@@ -186,50 +419,90 @@ public:
 #endif
     //const QVector<Agent*>& agentList() { agentListAccess.lock(); return agents; }
     //void agentListRealease() { agentListAccess.unlock();}
-    void forEachAgent(std::function<void(Agent*)> f)
+    template<class F> void forEachAgent(F f)
+    {
+        QMutexLocker lock(&agentListAccess);
+        for (Agent* agent : qAsConst(agents))
+            f(agent);
+    }
+    template<class F> void forEachAgent(F f) const
+    {
+        QMutexLocker lock(&agentListAccess);
+        for (const Agent* agent : agents)
+            f(agent);
+    }
+
+    /** Call f for every agent from the thread pool, chunkSize agents per task.
+
+        f must be safe to call concurrently, agentListAccess is held for the whole walk
+    */
+    template<class F> void parallelForEachAgent(F f, int chunkSize = PARALLEL_FOR_EACH_CHUNK_SIZE)
     {
         QMutexLocker lock(&agentListAccess);
-        //foreach (QVector<Agent*> cluster, agents)
+        Agent* const* items = agents.constData();
+        QVector<QPair<int, int>> chunks = agentChunks(chunkSize);
+        blockingMapOn(&tickPool, chunks, [items, &f](const QPair<int, int>& chunk)
         {
-            foreach(Agent* agent, agents)
-                f(agent);
-        }
+            for (int i = chunk.first; i < chunk.second; i++)
+                f(items[i]);
+        });
     }
-    void forEachAgent(std::function<void(const Agent*)> f) const
+    template<class F> void parallelForEachAgent(F f, int chunkSize = PARALLEL_FOR_EACH_CHUNK_SIZE) const
     {
         QMutexLocker lock(&agentListAccess);
-        //foreach (QVector<Agent*> cluster, agents)
+        const Agent* const* items = agents.constData();
+        QVector<QPair<int, int>> chunks = agentChunks(chunkSize);
+        blockingMapOn(&tickPool, chunks, [items, &f](const QPair<int, int>& chunk)
         {
-            foreach(const Agent* agent, agents)
-                f(agent);
-        }
+            for (int i = chunk.first; i < chunk.second; i++)
+                f(items[i]);
+        });
+    }
+
+    /** Agent list as it was at the end of the last tick.
+
+        Taking it doesn't wait for a running tick. Agents themselves may be changed by that tick meanwhile,
+        so only read what tolerates it. Agents in the list stay allocated as long as the guard lives
+    */
+    QVector<Agent*> publishedAgentList(EpochGuard&) const
+    {
+        QMutexLocker lock(&publishedAgentsAccess);
+        return publishedAgents;
+    }
+    /// read-only walk over publishedAgentList(), agentListAccess is not taken
+    template<class F> void forEachAgentReadOnly(F f) const
+    {
+        EpochGuard guard(reclaimer);
+        const QVector<Agent*> list = publishedAgentList(guard);
+        for (const Agent* agent : list)
+            f(agent);
     }
 
     mutable QMutex resourcesAccess;
-    void forEachResource(std::function<void(WorldObject*)> f)
+    template<class F> void forEachResource(F f)
     {
         QMutexLocker lock(&resourcesAccess);
-        foreach(WorldObject* poi, pResources)
+        for (WorldObject* poi : qAsConst(pResources))
             f(poi);
     }
-    void forEachResource(std::function<void(const WorldObject*)> f) const
+    template<class F> void forEachResource(F f) const
     {
         QMutexLocker lock(&resourcesAccess);
-        foreach(WorldObject* poi, pResources)
+        for (const WorldObject* poi : pResources)
             f(poi);
     }
 
     mutable QMutex warehouseAccess;
-    void forEachWarehouse(std::function<void(WorldObject*)> f)
+    template<class F> void forEachWarehouse(F f)
     {
         QMutexLocker lock(&warehouseAccess);
-        foreach(WorldObject* poi, pWarehouse)
+        for (WorldObject* poi : qAsConst(pWarehouse))
             f(poi);
     }
-    void forEachWarehouse(std::function<void(const WorldObject*)> f) const
+    template<class F> void forEachWarehouse(F f) const
     {
         QMutexLocker lock(&warehouseAccess);
-        foreach(WorldObject* poi, pWarehouse)
+        for (const WorldObject* poi : pWarehouse)
             f(poi);
     }
 
@@ -243,22 +516,32 @@ public slots:
 
     Agent *generateNewAgent(QPointF);
     void iteration();
+    void runUntil(quint64 lastTick);
+    /// run ticks back to back without iterationStart/iterationEnd, then publish advanced()
+    void advance(quint64 ticks);
 
     void onStart();
 
     void read (const QJsonObject& json);
     void write (QJsonObject& json) const;
 
+    /** Replace initial world with a scenario in the format of write(), e.g. a saved state.
+
+        The file is streamed, agents and POIs are created as they are read. Must be called before start
+        and not for a split world; throws std::runtime_error if the file can't be read or parsed
+    */
+    void loadScenario(const QString& fileName);
+
 signals:
-    void agentCreated(Agent* a);
-    void agentDied(Agent* );
+    /// once per tick (every LIFECYCLE_BATCH_TICKS ticks in batch mode), empty if no agent was created or died meanwhile
+    void agentsChanged(AgentLifecycle changes);
     void resourceDepleted(WorldObject* );
     void resourceAppeared(WorldObject* );
     void warehouseAppeared(WorldObject* );
 
     void iterationStart();
     void iterationEnd(qint64);
-
-    void requestNewAgent(QPointF);
+    void advanced(WorldSummary);
+    void finished();
 };
 #endif // WORLD_H